@@ -0,0 +1,204 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+// Counts the chunks in use and refuses to give more than `max` of them
+typedef struct
+{
+	int live;
+	int total;
+	int max;
+} counter;
+
+static void *count_alloc(void *user, unsigned long size)
+{
+	counter *c = (counter *)user;
+	if (c->total == c->max)
+		return NULL;
+	c->live++;
+	c->total++;
+	return malloc(size);
+}
+
+static void count_free(void *user, void *chunk, unsigned long size)
+{
+	(void)size;
+	((counter *)user)->live--;
+	free(chunk);
+}
+
+#define ROUTE_CNT 400
+static char routes[ROUTE_CNT][64];
+static char paths[ROUTE_CNT][64];
+
+// Look up each path in both routers and compare the results
+static void check_same(const urlrouter *router, const urlrouter *fixed)
+{
+	for (int i = 0; i < ROUTE_CNT; i++)
+	{
+		urlparam expected[4], params[4];
+		urlrouter_match m1, m2;
+		const void *data =
+			urlrouter_find_match(fixed, "t1.example.com", paths[i], expected, 4, &m1);
+		CHECK(data != NULL);
+		CHECK(urlrouter_find_match(router, "t1.example.com", paths[i], params, 4, &m2) == data);
+		CHECK(m1.route == m2.route && m1.param_cnt == m2.param_cnt);
+		for (unsigned int j = 0; j < m1.param_cnt; j++)
+			CHECK(params[j].value == expected[j].value && params[j].len == expected[j].len);
+
+		char url1[128], url2[128];
+		if (m1.router == fixed)
+		{
+			CHECK(urlrouter_url_for(fixed, m1.route, expected, 4, url1, sizeof(url1)) ==
+				  urlrouter_url_for(router, m2.route, params, 4, url2, sizeof(url2)));
+			CHECK(strcmp(url1, url2) == 0);
+		}
+	}
+	CHECK(urlrouter_find(router, "/nope", NULL, 0, NULL) == NULL);
+}
+
+// Add the same routes to `router` and to `fixed`, with host routes and a mount
+static void add_routes(urlrouter *router, urlrouter *fixed, const urlrouter *sub)
+{
+	for (int i = 0; i < ROUTE_CNT; i++)
+	{
+		if (i % 10 == 0)
+		{
+			CHECK(urlrouter_add_host(router, "{tenant}.example.com", routes[i], routes[i]) >= 0);
+			CHECK(urlrouter_add_host(fixed, "{tenant}.example.com", routes[i], routes[i]) >= 0);
+		}
+		else
+		{
+			CHECK(urlrouter_add(router, routes[i], routes[i]) >= 0);
+			CHECK(urlrouter_add(fixed, routes[i], routes[i]) >= 0);
+		}
+		if (i == ROUTE_CNT / 2)
+		{
+			CHECK(urlrouter_mount(router, "/mnt/{v}", sub) >= 0);
+			CHECK(urlrouter_mount(fixed, "/mnt/{v}", sub) >= 0);
+		}
+	}
+}
+
+int main(void)
+{
+	for (int i = 0; i < ROUTE_CNT; i++)
+	{
+		snprintf(routes[i], sizeof(routes[i]), "/res%d/{id}/items%s", i, i % 3 ? "/{item}" : "");
+		snprintf(paths[i], sizeof(paths[i]), "/res%d/%d/items%s", i, i * 7, i % 3 ? "/x" : "");
+	}
+	static char sub_buf[1024], fixed_buf[1 << 18];
+	urlrouter sub, fixed;
+	urlrouter_init(&sub, sub_buf, sizeof(sub_buf));
+	CHECK(urlrouter_add(&sub, "/users/{id}", "user") >= 0);
+	urlrouter_init(&fixed, fixed_buf, sizeof(fixed_buf));
+
+	// Without a buffer, the chunks are given by the allocator
+	counter c = {0, 0, -1};
+	urlrouter_allocator allocator = {count_alloc, count_free, &c, 2048};
+	urlrouter router;
+	urlrouter_init(&router, NULL, 0);
+	urlrouter_set_allocator(&router, &allocator);
+	add_routes(&router, &fixed, &sub);
+	CHECK(router.route_cnt == fixed.route_cnt);
+	CHECK(router.chunk_cnt > 10 && c.live == (int)router.chunk_cnt);
+	check_same(&router, &fixed);
+	CHECK(urlrouter_find(&router, "/mnt/v1/users/1", NULL, 0, NULL) != NULL);
+
+	// The chunks are copied into one, the lookups are the same
+	int remaining = urlrouter_repack(&router);
+	CHECK(remaining == 0 && router.chunk_cnt == 1 && c.live == 1);
+	check_same(&router, &fixed);
+	urlparam params[4];
+	urlrouter_match match;
+	CHECK(urlrouter_find_match(&router, NULL, "/mnt/v1/users/1", params, 4, &match) != NULL);
+	CHECK(match.router == &sub && params[0].len == 2 && match.param_cnt == 1);
+	CHECK(urlrouter_repack(&router) == 0 && c.live == 1);
+
+	// More routes can be added after, a route that does not fit in a chunk is retried with bigger
+	// chunks and the empty ones are released
+	static char long_route[4096];
+	memset(long_route, 'a', sizeof(long_route) - 1);
+	long_route[0] = '/';
+	CHECK(urlrouter_add(&router, long_route, long_route) >= 0);
+	CHECK(urlrouter_find(&router, long_route, NULL, 0, NULL) == long_route);
+	CHECK(router.chunk_cnt == 2 && c.live == 2);
+
+	urlrouter_free(&router);
+	CHECK(c.live == 0 && router.route_cnt == 0 && router.root == NULL);
+	CHECK(urlrouter_add(&router, "/again", "again") >= 0);
+	CHECK(urlrouter_find(&router, "/again", NULL, 0, NULL) != NULL);
+	urlrouter_free(&router);
+	CHECK(c.live == 0);
+
+	// A full allocator leaves the router as it was
+	char buf[512];
+	urlrouter_init(&router, buf, sizeof(buf));
+	c = (counter){0, 0, 2};
+	urlrouter_set_allocator(&router, &allocator);
+	int err = 0, added = 0;
+	while ((err = urlrouter_add(&router, routes[added], routes[added])) >= 0)
+		added++;
+	CHECK(err == URLROUTER_ERR_BUFF_FULL && c.total == 2);
+	CHECK(router.route_cnt == (unsigned int)added);
+	for (int i = 0; i < added; i++)
+		CHECK(urlrouter_find(&router, paths[i], NULL, 0, NULL) == routes[i]);
+	CHECK(urlrouter_repack(&router) == URLROUTER_ERR_BUFF_FULL);
+	CHECK(urlrouter_find(&router, paths[0], NULL, 0, NULL) == routes[0]);
+	urlrouter_free(&router);
+	CHECK(c.live == 0);
+
+	// The routes of the buffer given to urlrouter_init are moved too, and a DFA is kept
+	c = (counter){0, 0, -1};
+	allocator.chunk_size = 1 << 18;
+	urlrouter_init(&router, buf, sizeof(buf));
+	urlrouter_set_allocator(&router, &allocator);
+	for (int i = 0; i < 40; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+	CHECK(router.chunk_cnt == 1);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) >= 0);
+	CHECK(urlrouter_repack(&router) >= 0 && c.live == 1);
+	CHECK(router.dfa != NULL);
+	for (int i = 0; i < 40; i++)
+	{
+		unsigned int cnt = 0;
+		CHECK(urlrouter_find(&router, paths[i], params, 4, &cnt) == routes[i]);
+		CHECK(cnt == 1 + (i % 3 != 0) && params[0].value == strchr(paths[i] + 1, '/') + 1);
+	}
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE) >= 0);
+	urlrouter_free(&router);
+
+	// The bulk builds are retried in a bigger chunk
+	const char *list[ROUTE_CNT];
+	const void *data[ROUTE_CNT];
+	for (int i = 0; i < ROUTE_CNT; i++)
+		list[i] = data[i] = routes[i];
+	c = (counter){0, 0, -1};
+	allocator.chunk_size = 1024;
+	for (int threads = 1; threads <= 4; threads += 3)
+	{
+		urlrouter_init(&router, NULL, 0);
+		urlrouter_set_allocator(&router, &allocator);
+		CHECK(urlrouter_build_parallel(&router, list, data, ROUTE_CNT, NULL, threads) >= 0);
+		CHECK(router.chunk_cnt == 1 && c.live == 1);
+		for (int i = 0; i < ROUTE_CNT; i++)
+			CHECK(urlrouter_find(&router, paths[i], NULL, 0, NULL) == routes[i]);
+		urlrouter_free(&router);
+		CHECK(c.live == 0);
+	}
+
+	// Without allocator, a full buffer is an error
+	urlrouter_init(&router, buf, sizeof(buf));
+	while ((err = urlrouter_add(&router, routes[added], routes[added])) >= 0)
+		added++;
+	CHECK(err == URLROUTER_ERR_BUFF_FULL && router.chunk_cnt == 0);
+	CHECK(urlrouter_repack(&router) >= 0);
+
+	printf("All arena tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,474 @@
+#define _POSIX_C_SOURCE 199309L
+// For syscall
+#define _DEFAULT_SOURCE
+
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define LOOKUPS 2000000
+#define PATHS 4096
+
+typedef struct
+{
+	const char *name;
+	const char **routes;
+	const void **data;
+	unsigned long n;
+	// Paths to look up
+	const char *paths[PATHS];
+} route_set;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Hardware counters read around the urlrouter_find loops when BENCH_PERF is set. They are
+// opened as one group led by the cycles, a counter the CPU does not have prints "-".
+#define PERF_COUNTERS 5
+static const char *perf_names[PERF_COUNTERS] = {
+	"cycles", "instructions", "L1d misses", "LLC misses", "branch misses",
+};
+static int perf_fds[PERF_COUNTERS] = {-1, -1, -1, -1, -1};
+// Value, time enabled and time running of each counter at the last perf_stop
+static unsigned long long perf_values[PERF_COUNTERS][3];
+
+// Returns 0 if the counters can't be used, like in most containers
+static int perf_open(void)
+{
+#ifdef __linux__
+	static const struct
+	{
+		unsigned int type;
+		unsigned long long config;
+	} events[PERF_COUNTERS] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HW_CACHE,
+			PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	};
+	for (int i = 0; i < PERF_COUNTERS; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = i == 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		perf_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, perf_fds[0], 0);
+		if (perf_fds[0] < 0)
+		{
+			printf("perf counters not available: %s\n", strerror(errno));
+			return 0;
+		}
+	}
+	return 1;
+#else
+	printf("perf counters not available: not Linux\n");
+	return 0;
+#endif
+}
+
+static void perf_start(void)
+{
+#ifdef __linux__
+	if (perf_fds[0] < 0)
+		return;
+	ioctl(perf_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+// Stop the counters and read them, before anything else runs
+static void perf_stop(void)
+{
+#ifdef __linux__
+	if (perf_fds[0] < 0)
+		return;
+	ioctl(perf_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	for (int i = 0; i < PERF_COUNTERS; i++)
+	{
+		if (perf_fds[i] < 0 ||
+			read(perf_fds[i], perf_values[i], sizeof(perf_values[i])) != sizeof(perf_values[i]))
+			perf_values[i][2] = 0;
+	}
+#endif
+}
+
+// Print the counters read by perf_stop per lookup. The ones that only ran part of the time,
+// because the group was multiplexed with other events, are scaled and marked with a '*'.
+static void perf_print(void)
+{
+	if (perf_fds[0] < 0)
+		return;
+	int scaled = 0;
+	printf("\t%-22s", "");
+	for (int i = 0; i < PERF_COUNTERS; i++)
+	{
+		const unsigned long long *v = perf_values[i];
+		if (v[2] == 0)
+		{
+			printf("        - %s", perf_names[i]);
+			continue;
+		}
+		double value = (double)v[0] * v[1] / v[2];
+		printf(" %8.2f%s %s", value / LOOKUPS, v[2] < v[1] ? "*" : "", perf_names[i]);
+		scaled |= v[2] < v[1];
+	}
+	printf(" /lookup\n");
+	if (perf_values[0][2] == 0)
+		printf("\t%-22s  the counters were not scheduled\n", "");
+	else if (scaled)
+		printf("\t%-22s  * scaled, the counters were multiplexed\n", "");
+}
+
+static char *dup_str(const char *str)
+{
+	unsigned long len = 0;
+	while (str[len])
+		len++;
+	char *s = malloc(len + 1);
+	for (unsigned long i = 0; i <= len; i++)
+		s[i] = str[i];
+	return s;
+}
+
+static char *dup_printf(const char *fmt, unsigned long a, unsigned long b)
+{
+	char tmp[128];
+	snprintf(tmp, sizeof(tmp), fmt, a, b);
+	return dup_str(tmp);
+}
+
+// Per-tenant vanity paths: a few routes under a distinct prefix for each tenant, in
+// random order
+static void make_tenants(route_set *set, unsigned long tenants)
+{
+	static const char *templates[] = {
+		"/t%lu/users",
+		"/t%lu/users/{id}",
+		"/t%lu/users/{id}/posts/{post}",
+		"/t%lu/static/app.js",
+	};
+	static const char *lookups[] = {
+		"/t%lu/users",
+		"/t%lu/users/%lu",
+		"/t%lu/users/%lu/posts/42",
+		"/t%lu/static/app.js",
+	};
+	const unsigned long per_tenant = sizeof(templates) / sizeof(templates[0]);
+
+	set->name = "tenants";
+	set->n = tenants * per_tenant;
+	set->routes = malloc(set->n * sizeof(*set->routes));
+	set->data = malloc(set->n * sizeof(*set->data));
+	for (unsigned long i = 0; i < set->n; i++)
+	{
+		set->routes[i] = dup_printf(templates[i % per_tenant], i / per_tenant, 0);
+		set->data[i] = set->routes[i];
+	}
+	srand(42);
+	for (unsigned long i = set->n - 1; i > 0; i--)
+	{
+		unsigned long j = rand() % (i + 1);
+		const char *tmp = set->routes[i];
+		set->routes[i] = set->routes[j];
+		set->routes[j] = tmp;
+		set->data[i] = set->routes[i];
+		set->data[j] = set->routes[j];
+	}
+	for (unsigned long i = 0; i < PATHS; i++)
+	{
+		unsigned long route = rand() % set->n;
+		set->paths[i] = dup_printf(lookups[route % per_tenant], route / per_tenant, rand() % 1000);
+	}
+}
+
+// A small REST API: a few resources with nested routes
+static void make_api(route_set *set)
+{
+	static const char *resources[] = {"users", "repos", "orgs",  "issues",
+									  "pulls", "gists", "teams", "projects"};
+	static const char *templates[] = {
+		"/%s", "/%s/{id}", "/%s/{id}/comments", "/%s/{id}/comments/{comment}", "/%s/{id}/events",
+	};
+	static const char *lookups[] = {
+		"/%s", "/%s/%lu", "/%s/%lu/comments", "/%s/%lu/comments/7", "/%s/%lu/events",
+	};
+	const unsigned long res_cnt = sizeof(resources) / sizeof(resources[0]);
+	const unsigned long per_res = sizeof(templates) / sizeof(templates[0]);
+	char tmp[128];
+
+	set->name = "api";
+	set->n = res_cnt * per_res;
+	set->routes = malloc(set->n * sizeof(*set->routes));
+	set->data = malloc(set->n * sizeof(*set->data));
+	for (unsigned long i = 0; i < set->n; i++)
+	{
+		snprintf(tmp, sizeof(tmp), templates[i % per_res], resources[i / per_res]);
+		set->routes[i] = dup_str(tmp);
+		set->data[i] = set->routes[i];
+	}
+	srand(7);
+	for (unsigned long i = 0; i < PATHS; i++)
+	{
+		unsigned long route = rand() % set->n;
+		snprintf(tmp, sizeof(tmp), lookups[route % per_res], resources[route / per_res],
+				 (unsigned long)rand() % 100000);
+		set->paths[i] = dup_str(tmp);
+	}
+}
+
+// The api routes probed by scanners: most lookups are for paths of other applications
+static void make_scan(route_set *set, const route_set *api)
+{
+	static const char *probes[] = {
+		"/wp-admin/%lu", "/.env", "/wp-login.php", "/phpmyadmin/index.php", "/.git/config",
+		"/admin/%lu", "/cgi-bin/%lu.cgi", "/vendor/phpunit/%lu", "/xmlrpc.php", "/backup.zip",
+		"/%lu.php", "/.aws/credentials", "/users/%lu/.env", "/server-status", "/api/v1/%lu",
+	};
+	const unsigned long probe_cnt = sizeof(probes) / sizeof(probes[0]);
+	char tmp[128];
+
+	set->name = "scan";
+	set->routes = api->routes;
+	set->data = api->data;
+	set->n = api->n;
+	srand(11);
+	for (unsigned long i = 0; i < PATHS; i++)
+	{
+		// One lookup out of 10 is a real request
+		if (rand() % 10 == 0)
+		{
+			set->paths[i] = api->paths[rand() % PATHS];
+			continue;
+		}
+		snprintf(tmp, sizeof(tmp), probes[rand() % probe_cnt], (unsigned long)rand() % 1000);
+		set->paths[i] = dup_str(tmp);
+	}
+}
+
+// The scan probes with localized docs routes, whose param comes before the first 4 bytes
+static void make_scan_lang(route_set *set, const route_set *scan)
+{
+	static const char *lang[] = {"/{lang}/docs", "/{lang}/docs/{page}"};
+	const unsigned long lang_cnt = sizeof(lang) / sizeof(lang[0]);
+
+	set->name = "scan-lang";
+	set->n = scan->n + lang_cnt;
+	set->routes = malloc(set->n * sizeof(*set->routes));
+	set->data = malloc(set->n * sizeof(*set->data));
+	for (unsigned long i = 0; i < set->n; i++)
+	{
+		set->routes[i] = i < scan->n ? scan->routes[i] : lang[i - scan->n];
+		set->data[i] = set->routes[i];
+	}
+	for (unsigned long i = 0; i < PATHS; i++)
+		set->paths[i] = scan->paths[i];
+}
+
+static unsigned long buffer_size(const route_set *set)
+{
+	return set->n * (4 * sizeof(urlrouter_node) + 16);
+}
+
+static void bench_build(const route_set *set, void *buf, unsigned int max_threads)
+{
+	urlrouter router;
+	unsigned long len = buffer_size(set);
+	printf("%s: build %lu routes\n", set->name, set->n);
+
+	double start = now_ms();
+	urlrouter_init(&router, buf, len);
+	for (unsigned long i = 0; i < set->n; i++)
+		urlrouter_add(&router, set->routes[i], set->data[i]);
+	printf("\turlrouter_add          %10.2f ms  %lu bytes\n", now_ms() - start, router.cursor);
+
+	start = now_ms();
+	urlrouter_init(&router, buf, len);
+	urlrouter_build(&router, set->routes, set->data, set->n, NULL);
+	printf("\turlrouter_build        %10.2f ms  %lu bytes\n", now_ms() - start, router.cursor);
+
+	for (unsigned int threads = 1; threads <= max_threads; threads *= 2)
+	{
+		start = now_ms();
+		urlrouter_init(&router, buf, len);
+		urlrouter_build_parallel(&router, set->routes, set->data, set->n, NULL, threads);
+		printf("\tbuild_parallel(%2u)     %10.2f ms  %lu bytes\n", threads, now_ms() - start,
+			   router.cursor);
+	}
+}
+
+static void print_find(const char *name, double start, unsigned long found)
+{
+	printf("\t%-22s %10.2f ns/lookup  %lu/%d found\n", name, (now_ms() - start) * 1e6 / LOOKUPS,
+		   found, LOOKUPS);
+}
+
+static void bench_find(const route_set *set, void *buf, unsigned long len)
+{
+	urlrouter router;
+	urlparam params[8];
+	unsigned int param_cnt;
+	unsigned long found = 0;
+	urlrouter_init(&router, buf, len);
+	urlrouter_build(&router, set->routes, set->data, set->n, NULL);
+#ifdef URLROUTER_IMPLEMENTATION
+	printf("%s: find (header-only)\n", set->name);
+#else
+	printf("%s: find (linked)\n", set->name);
+#endif
+
+	perf_start();
+	double start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+	{
+		param_cnt = 0;
+		found += urlrouter_find(&router, set->paths[i % PATHS], params, 8, &param_cnt) != NULL;
+	}
+	perf_stop();
+	print_find("urlrouter_find", start, found);
+	perf_print();
+
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+		found += urlrouter_find_fixed(&router, set->paths[i % PATHS], params, &param_cnt) != NULL;
+	print_find("urlrouter_find_fixed", start, found);
+
+	// Per-route counters indexed by the route id
+	const unsigned int id_cnt = urlrouter_id_cnt(&router);
+	unsigned long *hits = calloc(id_cnt + 1, sizeof(unsigned long));
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+	{
+		param_cnt = 0;
+		int id = urlrouter_find_id(&router, set->paths[i % PATHS], params, 8, &param_cnt);
+		hits[id < 0 ? id_cnt : (unsigned int)id]++;
+	}
+	found = LOOKUPS - hits[id_cnt];
+	print_find("urlrouter_find_id", start, found);
+	free(hits);
+
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+		found += urlrouter_find_noparams(&router, set->paths[i % PATHS]) != NULL;
+	print_find("urlrouter_find_noparams", start, found);
+
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+		found += urlrouter_exists(&router, set->paths[i % PATHS]);
+	print_find("urlrouter_exists", start, found);
+
+	// A thread-local cache helps when a few paths are requested most of the time
+	static urlrouter_cache cache;
+	for (unsigned long hot = PATHS; hot >= 16; hot /= 16)
+	{
+		urlrouter_cache_init(&cache);
+		start = now_ms();
+		for (unsigned long i = 0; i < LOOKUPS; i++)
+		{
+			param_cnt = 0;
+			urlrouter_find_cached(&router, &cache, set->paths[i % hot], params, 8, &param_cnt);
+		}
+		printf("\t%-22s %10.2f ns/lookup  %lu paths, %.1f%% hits\n", "urlrouter_find_cached",
+			   (now_ms() - start) * 1e6 / LOOKUPS, hot, cache.hits * 100.0 / LOOKUPS);
+	}
+
+	// The paths fed in two chunks, as if they were split across two reads
+	unsigned long lens[PATHS];
+	for (unsigned long i = 0; i < PATHS; i++)
+		for (lens[i] = 0; set->paths[i][lens[i]] != '\0'; lens[i]++)
+			;
+	urlrouter_matcher m;
+	urlrouter_chunk_param chunk_params[8];
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+	{
+		const char *path = set->paths[i % PATHS];
+		unsigned long half = lens[i % PATHS] / 2;
+		urlrouter_match_begin(&m, &router);
+		urlrouter_match_feed(&m, path, half);
+		urlrouter_match_feed(&m, path + half, lens[i % PATHS] - half);
+		found += urlrouter_match_end(&m, chunk_params, 8, &param_cnt) != NULL;
+	}
+	print_find("urlrouter_match_feed", start, found);
+
+	// The same lookups with the DFA, if it fits in the space left
+	start = now_ms();
+	int ret = urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA);
+	if (ret < 0)
+	{
+		printf("\t%-22s %10.2f ms  does not fit\n", "urlrouter_set_engine", now_ms() - start);
+		return;
+	}
+	printf("\t%-22s %10.2f ms  %lu bytes\n", "urlrouter_set_engine", now_ms() - start,
+		   router.cursor);
+
+	found = 0;
+	perf_start();
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+	{
+		param_cnt = 0;
+		found += urlrouter_find(&router, set->paths[i % PATHS], params, 8, &param_cnt) != NULL;
+	}
+	perf_stop();
+	print_find("urlrouter_find (DFA)", start, found);
+	perf_print();
+
+	found = 0;
+	start = now_ms();
+	for (unsigned long i = 0; i < LOOKUPS; i++)
+		found += urlrouter_exists(&router, set->paths[i % PATHS]);
+	print_find("urlrouter_exists (DFA)", start, found);
+	urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long tenants = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+	unsigned int max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+
+	if (getenv("BENCH_PERF") != NULL)
+		perf_open();
+
+	static route_set set, api, scan, scan_lang;
+	make_tenants(&set, tenants);
+	make_api(&api);
+	make_scan(&scan, &api);
+	make_scan_lang(&scan_lang, &scan);
+	void *buf = malloc(buffer_size(&set));
+
+	bench_build(&set, buf, max_threads);
+	// The whole buffer is given to each set, so that there is room for the DFA
+	bench_find(&set, buf, buffer_size(&set));
+	bench_find(&api, buf, buffer_size(&set));
+	bench_find(&scan, buf, buffer_size(&set));
+	bench_find(&scan_lang, buf, buffer_size(&set));
+	return 0;
+}
@@ -0,0 +1,132 @@
+#define URLROUTER_ASSERT
+// Small limits so that the tests hit them
+#define URLROUTER_CACHE_ENTRIES 4
+#define URLROUTER_CACHE_PATH 20
+#define URLROUTER_CACHE_PARAMS 2
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+// Look up `path` with and without the cache and compare
+static const void *check_find(const urlrouter *router, urlrouter_cache *cache, const char *path)
+{
+	urlparam expected[8], params[8];
+	unsigned int expected_cnt = 0, param_cnt = 0;
+	const void *data = urlrouter_find(router, path, expected, 8, &expected_cnt);
+	CHECK(urlrouter_find_cached(router, cache, path, params, 8, &param_cnt) == data);
+	CHECK(param_cnt == expected_cnt);
+	for (unsigned int i = 0; i < param_cnt; i++)
+	{
+		CHECK(params[i].value == expected[i].value);
+		CHECK(params[i].len == expected[i].len);
+	}
+	return data;
+}
+
+int main(void)
+{
+	static const char *routes[] = {
+		"/users",
+		"/users/{id}",
+		"/users/{id}/posts/{post}",
+		"/a/{b}/{c}/{d}",
+		"/static/app.js",
+		"/static/a/very/long/path.js",
+	};
+	const unsigned long n = sizeof(routes) / sizeof(routes[0]);
+	char buf[4096];
+	urlrouter router;
+	urlrouter_cache cache;
+	urlparam params[8];
+	unsigned int param_cnt;
+
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_build(&router, routes, (const void **)routes, n, NULL) >= 0);
+	urlrouter_cache_init(&cache);
+
+	// The params of a hit are slices of the given path, not of the cached one
+	char path[32];
+	strcpy(path, "/users/42/posts/7");
+	CHECK(check_find(&router, &cache, path) == routes[2]);
+	CHECK(cache.hits == 0 && cache.misses == 1);
+	char other[32];
+	strcpy(other, path);
+	CHECK(check_find(&router, &cache, other) == routes[2]);
+	CHECK(cache.hits == 1 && cache.misses == 1);
+
+	// A hit gives as many params as the array can hold
+	param_cnt = 0;
+	CHECK(urlrouter_find_cached(&router, &cache, other, params, 1, &param_cnt) == routes[2]);
+	CHECK(cache.hits == 2 && param_cnt == 1 && param_is(&params[0], "42"));
+	CHECK(urlrouter_find_cached(&router, &cache, other, NULL, 0, NULL) == routes[2]);
+	CHECK(cache.hits == 3);
+
+	// Lookups that can't be stored: too long, too many params, params that did not fit,
+	// and misses
+	const char *uncached[] = {"/static/a/very/long/path.js", "/a/1/2/3", "/nope", "/users/"};
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		unsigned long misses = cache.misses;
+		check_find(&router, &cache, uncached[i]);
+		check_find(&router, &cache, uncached[i]);
+		CHECK(cache.misses == misses + 2);
+	}
+	urlrouter_cache_init(&cache);
+	CHECK(urlrouter_find_cached(&router, &cache, "/users/1/posts/2", params, 1, NULL) == routes[2]);
+	CHECK(urlrouter_find_cached(&router, &cache, "/users/1/posts/2", params, 8, NULL) == routes[2]);
+	CHECK(cache.hits == 0 && cache.misses == 2);
+
+	// More hot paths than entries
+	const char *hot[] = {"/users", "/users/1", "/users/2", "/users/3", "/users/4/posts/5",
+						 "/static/app.js", "/a/1/2/3", "/users/1"};
+	for (unsigned int round = 0; round < 4; round++)
+	{
+		for (unsigned int i = 0; i < sizeof(hot) / sizeof(hot[0]); i++)
+			check_find(&router, &cache, hot[i]);
+	}
+
+	// Adding a route invalidates the cache
+	urlrouter_cache_init(&cache);
+	CHECK(check_find(&router, &cache, "/users/me") == routes[1]);
+	CHECK(check_find(&router, &cache, "/users/me") == routes[1]);
+	CHECK(cache.hits == 1);
+	CHECK(urlrouter_add(&router, "/users/me", buf) >= 0);
+	CHECK(check_find(&router, &cache, "/users/me") == buf);
+	CHECK(cache.hits == 1 && cache.misses == 2);
+
+	// Two routers with the same generation don't share their entries
+	char buf1[512], buf2[512];
+	urlrouter router1, router2;
+	urlrouter_init(&router1, buf1, sizeof(buf1));
+	urlrouter_init(&router2, buf2, sizeof(buf2));
+	CHECK(urlrouter_add(&router1, "/x", buf1) >= 0);
+	CHECK(urlrouter_add(&router2, "/x", buf2) >= 0);
+	CHECK(router1.generation == router2.generation);
+	urlrouter_cache_init(&cache);
+	CHECK(check_find(&router1, &cache, "/x") == buf1);
+	CHECK(check_find(&router2, &cache, "/x") == buf2);
+	CHECK(check_find(&router1, &cache, "/x") == buf1);
+	CHECK(cache.hits == 0 && cache.misses == 3);
+
+	// The empty path is not found in a reset entry, even of the same router and generation
+	for (unsigned int i = 0; i < sizeof(hot) / sizeof(hot[0]); i++)
+		check_find(&router, &cache, hot[i]);
+	urlrouter_cache_init(&cache);
+	CHECK(urlrouter_find_cached(&router, &cache, "", NULL, 0, NULL) == NULL);
+	CHECK(cache.hits == 0);
+
+	// The cache entries of a freed router are not valid anymore
+	urlrouter_cache_init(&cache);
+	CHECK(check_find(&router1, &cache, "/x") == buf1);
+	urlrouter_free(&router1);
+	CHECK(urlrouter_add(&router1, "/y", buf2) >= 0);
+	CHECK(check_find(&router1, &cache, "/x") == NULL);
+	CHECK(cache.hits == 0);
+
+	printf("All cache tests passed!\n");
+	return 0;
+}
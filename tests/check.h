@@ -0,0 +1,55 @@
+#ifndef URLROUTER_TESTS_CHECK_H
+#define URLROUTER_TESTS_CHECK_H
+
+// Helpers shared by the tests, to include after urlrouter.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Exit with the location of the check if `cond` is false, also in release builds
+#define CHECK(cond)                                                                                \
+	do                                                                                             \
+	{                                                                                              \
+		if (!(cond))                                                                               \
+		{                                                                                          \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);              \
+			exit(1);                                                                               \
+		}                                                                                          \
+	} while (0)
+
+// Whether a param is set to `value`
+static inline int param_is(const urlparam *param, const char *value)
+{
+	return param != NULL && param->len == strlen(value) &&
+		   memcmp(param->value, value, param->len) == 0;
+}
+
+// Bytes of the param values written by instantiate
+#define PARAM_CHARS "abcxyz019-._~%"
+
+// Write a path matching `route` in `out`, with random param values made of `chars`
+static inline void instantiate(const char *route, char *out, const char *chars)
+{
+	const size_t n = strlen(chars);
+	while (*route)
+	{
+		if ((route[0] == '{' && route[1] == '{') || (route[0] == '}' && route[1] == '}'))
+		{
+			*out++ = *route;
+			route += 2;
+		}
+		else if (*route == '{')
+		{
+			for (int i = rand() % 6; i >= 0; i--)
+				*out++ = chars[rand() % n];
+			while (*route++ != '}')
+				;
+		}
+		else
+			*out++ = *route++;
+	}
+	*out = '\0';
+}
+
+#endif // URLROUTER_TESTS_CHECK_H
@@ -0,0 +1,117 @@
+#include "urlrouter.h"
+#include "urlrouter.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "check.h"
+
+using handler = int (*)(std::string_view);
+
+static int list_users(std::string_view) { return 1; }
+static int get_user(std::string_view id) { return 2 + (id == "42"); }
+static int get_me(std::string_view) { return 4; }
+static int get_post(std::string_view) { return 5; }
+static int get_file(std::string_view) { return 6; }
+static int get_raw(std::string_view) { return 7; }
+
+constexpr urlrouter_cpp::route<handler> routes[] = {
+	{"/users", list_users},
+	{"/users/{id}", get_user},
+	{"/users/me", get_me},
+	{"/users/{id}/posts/{post}", get_post},
+	{"/src/{file}", get_file},
+	{"/raw/{{id}}", get_raw},
+};
+constexpr auto router = urlrouter_cpp::make_router(routes);
+
+// Everything below is evaluated by the compiler
+static_assert(router.find("/users").handler == list_users);
+static_assert(router.find("/users/42").handler == get_user);
+static_assert(router.find("/users/42").params[0] == "42");
+static_assert(router.find("/users/me").handler == get_me);
+static_assert(router.find("/users/mee").handler == get_user);
+static_assert(router.find("/users/7/posts/hello").param_cnt == 2);
+static_assert(router.find("/users/7/posts/hello").params[1] == "hello");
+static_assert(router.find("/raw/{id}").handler == get_raw);
+// The routes are identified by their index in the table
+static_assert(router.find("/users/me").route == 2);
+static_assert(router.find("/raw/{id}").route == 5);
+static_assert(!router.find("/users/"));
+static_assert(!router.find("/nope"));
+static_assert(!router.find("/raw/{{id}}"));
+static_assert(router.node_count() <= 2 * router.size());
+
+#ifdef URLROUTER_TEST_MALFORMED
+// Must not compile
+constexpr urlrouter_cpp::route<handler> bad[] = {{"/users/{id", get_user}};
+constexpr auto bad_router = urlrouter_cpp::make_router(bad);
+#endif
+
+#ifdef URLROUTER_TEST_DUPLICATE
+// Must not compile
+constexpr urlrouter_cpp::route<handler> dup[] = {
+	{"/users/{id}", get_user},
+	{"/users/{uid}", get_me},
+};
+constexpr auto dup_router = urlrouter_cpp::make_router(dup);
+#endif
+
+// The tree has a node per param and per literal run, and a lookup does not come back from a
+// child: "/q" is not matched by "/{b}" once the "q" node matched
+constexpr urlrouter_cpp::route<handler> tricky[] = {
+	{"/q{a}", get_user},
+	{"/{b}", get_file},
+	{"/x{{y", get_raw},
+	{"/x{{y}}/{c}", get_post},
+};
+constexpr auto tricky_router = urlrouter_cpp::make_router(tricky);
+static_assert(!tricky_router.find("/q"));
+static_assert(tricky_router.find("/x{y}/1").handler == get_post);
+
+// Same results as the C router built with urlrouter_add
+template <typename Router, std::size_t N, std::size_t P>
+static void check_same(const Router &router, const urlrouter_cpp::route<handler> (&table)[N],
+					   const char *const (&paths)[P])
+{
+	char buf[4096];
+	::urlrouter c_router;
+	urlrouter_init(&c_router, buf, sizeof(buf));
+	for (const auto &r : table)
+		CHECK(urlrouter_add(&c_router, r.path.data(), &r) >= 0);
+
+	for (const char *path : paths)
+	{
+		urlparam params[8];
+		unsigned int param_cnt = 0;
+		auto expected = static_cast<const urlrouter_cpp::route<handler> *>(
+			urlrouter_find(&c_router, path, params, 8, &param_cnt));
+		auto m = router.find(path);
+		CHECK(static_cast<bool>(m) == (expected != nullptr));
+		if (!m)
+			continue;
+		CHECK(m.handler == expected->handler && m.param_cnt == param_cnt);
+		for (unsigned int i = 0; i < param_cnt; i++)
+			CHECK(m.params[i] == std::string_view(params[i].value, params[i].len));
+	}
+}
+
+int main()
+{
+	static const char *const paths[] = {
+		"/users", "/users/42", "/users/me", "/users/mee", "/users/7/posts/hello", "/users/7/posts",
+		"/src/a.c", "/src/", "/src", "/nope", "/users/", "/users//posts/x", "/raw/{id}",
+		"/raw/{{id}}", "/raw/{id",
+	};
+	check_same(router, routes, paths);
+	static const char *const tricky_paths[] = {
+		"/q", "/qz", "/z", "/x", "/x{", "/x{y", "/x{z", "/x{y}", "/x{y}/", "/x{y}/1", "/x{y}/1/",
+	};
+	check_same(tricky_router, tricky, tricky_paths);
+
+	auto m = router.find("/users/42");
+	CHECK(m && m.handler(m.params[0]) == 3);
+
+	std::printf("All C++ tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,158 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+// Look up `path` with the tree and the DFA and compare
+static void check_path(urlrouter *router, const char *path)
+{
+	urlparam expected[8], params[8];
+	unsigned int expected_cnt = 0, param_cnt = 0;
+	CHECK(urlrouter_set_engine(router, URLROUTER_ENGINE_TREE) >= 0);
+	const void *data = urlrouter_find(router, path, expected, 8, &expected_cnt);
+	CHECK(urlrouter_set_engine(router, URLROUTER_ENGINE_DFA) >= 0);
+	if (urlrouter_find(router, path, params, 8, &param_cnt) != data)
+	{
+		fprintf(stderr, "%s: data differs from the tree\n", path);
+		exit(1);
+	}
+	CHECK(urlrouter_exists(router, path) == (data != NULL));
+	// The tree may count the params of a partial match on a miss
+	if (data == NULL)
+		return;
+	CHECK(param_cnt == expected_cnt);
+	for (unsigned int i = 0; i < param_cnt; i++)
+	{
+		CHECK(params[i].value == expected[i].value);
+		CHECK(params[i].len == expected[i].len);
+	}
+
+	// Fewer params than the route has
+	param_cnt = 0;
+	CHECK(urlrouter_find(router, path, params, 1, &param_cnt) == data);
+	CHECK(param_cnt == (expected_cnt > 0 ? 1 : 0));
+}
+
+static void check_routes(const char **routes, unsigned long n)
+{
+	char buf[1 << 16], path[256];
+	urlrouter router;
+	urlrouter_init(&router, buf, sizeof(buf));
+	for (unsigned long i = 0; i < n; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+
+	for (unsigned long i = 0; i < n * 100; i++)
+	{
+		instantiate(routes[i % n], path, PARAM_CHARS "{}");
+		check_path(&router, path);
+	}
+
+	// Truncated, extended or altered instances
+	for (unsigned long i = 0; i < 3000; i++)
+	{
+		instantiate(routes[rand() % n], path, PARAM_CHARS "{}");
+		unsigned long len = strlen(path);
+		if (rand() % 2)
+			path[rand() % (len + 1)] = '\0';
+		else if (len + 2 < sizeof(path))
+		{
+			path[len] = "/ax"[rand() % 3];
+			path[len + 1] = '\0';
+		}
+		unsigned long at = rand() % (strlen(path) + 1);
+		if (path[at] != '\0')
+			path[at] = "/a{\x80"[rand() % 4];
+		check_path(&router, path);
+	}
+	check_path(&router, "");
+	check_path(&router, "/");
+	check_path(&router, "//");
+}
+
+int main(void)
+{
+	srand(5);
+	static const char *api[] = {
+		"/users", "/users/{id}", "/users/{id}/posts/{post}", "/users/me",
+		"/static/app.js", "/v{ver}", "/{{raw}}/x", "/",
+	};
+	static const char *nested[] = {
+		"/users",
+		"/users/{id}",
+		"/users/{id}/posts/{post}",
+		"/users/me",
+		"/users/me/settings",
+		"/users/api/keys",
+		"/orgs/{org}/users/{id}",
+		"/src/{file}",
+		"/static/app.js",
+		"/{lang}/docs",
+		"/a/b/c/d/e/f",
+		"/{p}/b/c/d/e/g",
+		"/{p}/{q}/c/d/e/h",
+		"/{p}/{q}/{r}/d/e/i",
+	};
+	static const char *mixed[] = {"/file{name}", "/files/{name}", "/f{a}/x{b}/{c}", "/fi/{a}"};
+	static const char *no_slash[] = {"test", "test/{id}", "azd{azdazd}", "x/"};
+	check_routes(api, sizeof(api) / sizeof(api[0]));
+	check_routes(nested, sizeof(nested) / sizeof(nested[0]));
+	check_routes(mixed, sizeof(mixed) / sizeof(mixed[0]));
+	check_routes(no_slash, sizeof(no_slash) / sizeof(no_slash[0]));
+
+	char buf[16384];
+	urlrouter router;
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_build(&router, api, (const void **)api, 8, NULL) >= 0);
+	CHECK(urlrouter_add_host(&router, "example.com", "/users", buf) >= 0);
+	int rem = urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) >= 0);
+	CHECK(router.dfa != NULL);
+
+	// The other lookups use it too, host routes still walk the tree
+	urlparam params[2];
+	unsigned int param_cnt;
+	CHECK(urlrouter_find_fixed(&router, "/users/42", params, &param_cnt) == api[1]);
+	CHECK(param_cnt == 1 && params[0].len == 2);
+	CHECK(urlrouter_find_host(&router, "example.com", "/users", NULL, 0, NULL) == buf);
+	CHECK(urlrouter_find_host(&router, "other.com", "/users", NULL, 0, NULL) == api[0]);
+
+	// Switching back to the tree frees it
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE) == rem);
+	CHECK(router.dfa == NULL);
+
+	// Adding a route drops it
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) >= 0);
+	CHECK(urlrouter_add(&router, "/users/you", buf) >= 0);
+	CHECK(router.dfa == NULL);
+	CHECK(urlrouter_find(&router, "/users/you", NULL, 0, NULL) == buf);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) >= 0);
+	CHECK(urlrouter_find(&router, "/users/you", NULL, 0, NULL) == buf);
+
+	// A rejected route or mount keeps it, and the cached lookups
+	urlrouter sub;
+	urlrouter_init(&sub, NULL, 0);
+	unsigned int generation = router.generation;
+	CHECK(urlrouter_add(&router, "/users/you", NULL) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_add(&router, "/users/{id", NULL) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_add_host(&router, "example.com", "/users", NULL) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_mount(&router, "/users", &sub) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_mount(&router, "/{", &sub) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(router.dfa != NULL && router.generation == generation);
+
+	// Without room for the DFA, the tree is kept
+	char small[4096];
+	urlrouter_init(&router, small, sizeof(small));
+	CHECK(urlrouter_build(&router, api, (const void **)api, 8, NULL) >= 0);
+	rem = urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) == URLROUTER_ERR_BUFF_FULL);
+	CHECK(router.dfa == NULL);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_TREE) == rem);
+	CHECK(urlrouter_find(&router, "/users/42", NULL, 0, NULL) == api[1]);
+
+	printf("All DFA tests passed!\n");
+	return 0;
+}
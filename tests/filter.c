@@ -0,0 +1,137 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+// The streaming matcher walks the tree without the filter
+static const void *find_unfiltered(const urlrouter *router, const char *path)
+{
+	urlrouter_matcher m;
+	urlrouter_match_begin(&m, router);
+	urlrouter_match_feed(&m, path, strlen(path));
+	return urlrouter_match_end(&m, NULL, 0, NULL);
+}
+
+static void check_routes(const char **routes, unsigned long n)
+{
+	char buf[8192], path[256];
+	urlrouter router, built;
+	urlrouter_init(&router, buf, sizeof(buf) / 2);
+	for (unsigned long i = 0; i < n; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+
+	// urlrouter_build gives the same filter
+	urlrouter_init(&built, buf + sizeof(buf) / 2, sizeof(buf) / 2);
+	CHECK(urlrouter_build(&built, routes, (const void **)routes, n, NULL) >= 0);
+	CHECK(memcmp(&router.filter, &built.filter, sizeof(urlrouter_filter)) == 0);
+
+	// No false negative: each instance of a route is found, maybe by a route with priority
+	for (unsigned long i = 0; i < n * 200; i++)
+	{
+		instantiate(routes[i % n], path, PARAM_CHARS);
+		const void *expected = find_unfiltered(&router, path);
+		CHECK(urlrouter_find(&router, path, NULL, 0, NULL) == expected);
+		CHECK(urlrouter_exists(&router, path) == (expected != NULL));
+	}
+
+	// Random bytes and truncated or extended routes
+	for (unsigned long i = 0; i < 5000; i++)
+	{
+		instantiate(routes[rand() % n], path, PARAM_CHARS);
+		unsigned long len = strlen(path);
+		if (rand() % 2)
+			path[rand() % (len + 1)] = '\0';
+		else if (len + 2 < sizeof(path))
+		{
+			path[len] = "/ax"[rand() % 3];
+			path[len + 1] = '\0';
+		}
+		path[rand() % (strlen(path) + 1)] ^= rand() % 2 ? 0 : 1;
+		CHECK(urlrouter_find(&router, path, NULL, 0, NULL) == find_unfiltered(&router, path));
+	}
+}
+
+int main(void)
+{
+	srand(3);
+	static const char *api[] = {
+		"/users", "/users/{id}", "/users/{id}/posts/{post}", "/users/me",
+		"/static/app.js", "/v{ver}", "/{{raw}}/x", "/",
+	};
+	static const char *statics[] = {"/health", "/static/app.js", "/static/app.css", "/a/b/c"};
+	static const char *params[] = {"/{lang}/docs", "/{lang}", "/users/{id}"};
+	static const char *no_slash[] = {"test", "test/{id}", "azd{azdazd}", "x/"};
+	static const char *param_led[] = {"/{tenant}/users", "/{tenant}/users/{id}", "/v{n}/health",
+									  "{x}/test", "/{a}/b/{c}", "/api"};
+	check_routes(api, sizeof(api) / sizeof(api[0]));
+	check_routes(statics, sizeof(statics) / sizeof(statics[0]));
+	check_routes(params, sizeof(params) / sizeof(params[0]));
+	check_routes(no_slash, sizeof(no_slash) / sizeof(no_slash[0]));
+	check_routes(param_led, sizeof(param_led) / sizeof(param_led[0]));
+	check_routes(param_led, 4);
+
+	// Scanner paths are rejected by their prefix or their length
+	char buf[4096];
+	urlrouter router;
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(ur_filter_rejects(&router.filter, "/users"));
+	for (unsigned long i = 0; i < 4; i++)
+		CHECK(urlrouter_add(&router, statics[i], statics[i]) >= 0);
+	CHECK(!router.filter.any_prefix && router.filter.min_len == 6 && router.filter.max_len == 15);
+	CHECK(ur_filter_rejects(&router.filter, "/wp-admin"));
+	CHECK(ur_filter_rejects(&router.filter, "/.env"));
+	CHECK(ur_filter_rejects(&router.filter, "/a/b"));
+	CHECK(ur_filter_rejects(&router.filter, "/static/app.js.bak"));
+	CHECK(!ur_filter_rejects(&router.filter, "/static/app.js"));
+	CHECK(!ur_filter_rejects(&router.filter, "/static/other"));
+
+	// A param in a prefix is checked with the bytes after its '/'
+	CHECK(urlrouter_add(&router, "/{lang}/docs", buf) >= 0);
+	CHECK(!router.filter.any_prefix && router.filter.max_len == ~0u);
+	CHECK(!ur_filter_rejects(&router.filter, "/.env/docs"));
+	CHECK(!ur_filter_rejects(&router.filter, "/en/docs/x"));
+	CHECK(ur_filter_rejects(&router.filter, "/.env"));
+	CHECK(ur_filter_rejects(&router.filter, "/wp-admin/setup.php"));
+	CHECK(ur_filter_rejects(&router.filter, "/en/do"));
+	CHECK(ur_filter_rejects(&router.filter, "/.e"));
+
+	// A single segment can match a param ending the route
+	CHECK(urlrouter_add(&router, "/{lang}", buf) >= 0);
+	CHECK(!router.filter.any_prefix);
+	CHECK(!ur_filter_rejects(&router.filter, "/.env"));
+	CHECK(ur_filter_rejects(&router.filter, "/wp-admin/setup.php"));
+
+	// Too few bytes after the param disable the prefix filter, not the length one
+	CHECK(urlrouter_add(&router, "/{lang}/{page}", buf) >= 0);
+	CHECK(router.filter.any_prefix);
+	CHECK(!ur_filter_rejects(&router.filter, "/wp-admin/setup.php"));
+	CHECK(ur_filter_rejects(&router.filter, "/"));
+
+	// Host routes don't change it
+	urlrouter_filter filter = router.filter;
+	CHECK(urlrouter_add_host(&router, "example.com", "/", buf) >= 0);
+	CHECK(memcmp(&filter, &router.filter, sizeof(filter)) == 0);
+
+	// A mount after a param uses the filter of the mounted router
+	char sub_buf[1024], mount_buf[2048];
+	urlrouter sub, mounted;
+	urlrouter_init(&sub, sub_buf, sizeof(sub_buf));
+	urlrouter_init(&mounted, mount_buf, sizeof(mount_buf));
+	CHECK(urlrouter_add(&sub, "/users/{id}", buf) >= 0);
+	CHECK(urlrouter_add(&sub, "/health", buf) >= 0);
+	CHECK(urlrouter_mount(&mounted, "/{tenant}", &sub) >= 0);
+	CHECK(!mounted.filter.any_prefix);
+	CHECK(!ur_filter_rejects(&mounted.filter, "/acme/users/7"));
+	CHECK(!ur_filter_rejects(&mounted.filter, "/acme/health"));
+	CHECK(ur_filter_rejects(&mounted.filter, "/acme/wp-admin"));
+	CHECK(ur_filter_rejects(&mounted.filter, "/wp-admin"));
+	CHECK(urlrouter_mount(&mounted, "/x/{tenant}", &sub) >= 0);
+	CHECK(mounted.filter.any_prefix);
+
+	printf("All filter tests passed!\n");
+	return 0;
+}
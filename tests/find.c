@@ -0,0 +1,71 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+// A static node that only matches the start of a segment falls back to its param sibling,
+// which matches the segment from where the static node started
+static void check_sibling_restart(void)
+{
+	char buf[2048];
+	urlrouter router;
+	urlparam params[4];
+	unsigned int cnt = 0;
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add(&router, "/users/api/keys", "keys") >= 0);
+	CHECK(urlrouter_add(&router, "/users/{id}", "user") >= 0);
+	CHECK(urlrouter_add(&router, "/ab/c", "abc") >= 0);
+	CHECK(urlrouter_add(&router, "/{x}", "x") >= 0);
+
+	CHECK(urlrouter_find(&router, "/users/api/keys", params, 4, &cnt) == (void *)"keys");
+	CHECK(cnt == 0);
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/users/apple", params, 4, &cnt) == (void *)"user");
+	CHECK(cnt == 1 && param_is(&params[0], "apple"));
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/users/api", params, 4, &cnt) == (void *)"user");
+	CHECK(cnt == 1 && param_is(&params[0], "api"));
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/abd", params, 4, &cnt) == (void *)"x");
+	CHECK(cnt == 1 && param_is(&params[0], "abd"));
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/users/api/key", params, 4, &cnt) == NULL);
+}
+
+// A param matches at least one byte, so an empty segment does not match it
+static void check_empty_param(void)
+{
+	char buf[2048];
+	urlrouter router;
+	urlparam params[4];
+	unsigned int cnt = 0;
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add(&router, "/src/{file}", "file") >= 0);
+	CHECK(urlrouter_add(&router, "/doc/{page}/edit", "edit") >= 0);
+
+	CHECK(urlrouter_find(&router, "/src/", params, 4, &cnt) == NULL);
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/doc//edit", params, 4, &cnt) == NULL);
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/src/a", params, 4, &cnt) == (void *)"file");
+	CHECK(cnt == 1 && param_is(&params[0], "a"));
+
+	// With a route for the empty segment, it is the one found
+	CHECK(urlrouter_add(&router, "/src/", "dir") >= 0);
+	cnt = 0;
+	CHECK(urlrouter_find(&router, "/src/", params, 4, &cnt) == (void *)"dir");
+	CHECK(cnt == 0);
+}
+
+int main(void)
+{
+	check_sibling_restart();
+	check_empty_param();
+
+	printf("All find tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,83 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+static const char *API_USER = "api user", *SUB_USER = "sub user", *SUB_POSTS = "sub posts",
+				  *ANY_USER = "any user", *ROOT = "sub root";
+
+int main(void)
+{
+	char buf[4096];
+	urlrouter router;
+	urlparam params[4];
+	unsigned int cnt;
+	urlrouter_init(&router, buf, sizeof(buf));
+
+	CHECK(urlrouter_add_host(&router, "api.example.com", "/users/{id}", API_USER) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/users/{id}", SUB_USER) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/users/{id}/posts", SUB_POSTS) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/", ROOT) >= 0);
+	CHECK(urlrouter_add(&router, "/users/{id}", ANY_USER) >= 0);
+
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/users/{id}", NULL) ==
+		  URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_add_host(&router, "{sub.example.com", "/", NULL) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_add_host(&router, "{sub}example.com", "/", NULL) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_add_host(&router, "example.com/", "/", NULL) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_add_host(&router, "example.com", "users", NULL) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_add_host(&router, "example.com", "/{id}.json", NULL) ==
+		  URLROUTER_ERR_MALFORMED_PATH);
+
+	// Static hosts have priority over host params
+	cnt = 0;
+	CHECK(urlrouter_find_host(&router, "api.example.com", "/users/42", params, 4, &cnt) == API_USER);
+	CHECK(cnt == 1 && param_is(&params[0], "42"));
+
+	cnt = 0;
+	CHECK(urlrouter_find_host(&router, "acme.example.com", "/users/7", params, 4, &cnt) == SUB_USER);
+	CHECK(cnt == 2 && param_is(&params[0], "acme") && param_is(&params[1], "7"));
+
+	cnt = 0;
+	CHECK(urlrouter_find_host(&router, "acme.example.com", "/users/7/posts", params, 4, &cnt) ==
+		  SUB_POSTS);
+	CHECK(cnt == 2 && param_is(&params[0], "acme"));
+
+	cnt = 0;
+	CHECK(urlrouter_find_host(&router, "a.example.com", "/", params, 4, &cnt) == ROOT);
+	CHECK(cnt == 1 && param_is(&params[0], "a"));
+
+	// A host param does not span several labels, and unknown hosts use the other routes
+	cnt = 0;
+	CHECK(urlrouter_find_host(&router, "a.b.example.com", "/users/7", params, 4, &cnt) == ANY_USER);
+	CHECK(cnt == 1 && param_is(&params[0], "7"));
+	CHECK(urlrouter_find_host(&router, "example.org", "/users/7", NULL, 0, NULL) == ANY_USER);
+	CHECK(urlrouter_find_host(&router, "example.org", "/", NULL, 0, NULL) == NULL);
+
+	// Host routes are not matched without host
+	CHECK(urlrouter_find(&router, "/", NULL, 0, NULL) == NULL);
+
+	// The url of a host route starts with its host
+	char url[64];
+	urlparam values[] = {{"acme", 4}, {"7", 1}};
+	CHECK(urlrouter_url_for(&router, 1, values, 2, url, sizeof(url)) == 24);
+	CHECK(strcmp(url, "acme.example.com/users/7") == 0);
+
+	// The bytes can't move between the host and the path
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add_host(&router, "admin.example.com", "/panel", API_USER) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/{page}", SUB_USER) >= 0);
+	CHECK(urlrouter_add(&router, "m/panel", ANY_USER) >= 0);
+	CHECK(urlrouter_find_host(&router, "admin.example.com", "/panel", NULL, 0, NULL) == API_USER);
+	CHECK(urlrouter_find_host(&router, "admin.example.co", "m/panel", NULL, 0, NULL) == ANY_USER);
+	CHECK(urlrouter_find_host(&router, "admin.example.com/panel", "", NULL, 0, NULL) == NULL);
+	CHECK(urlrouter_find_host(&router, "a.example.com/x", "/y", NULL, 0, NULL) == NULL);
+	CHECK(urlrouter_find_host(&router, "a.example.com", "/y", NULL, 0, NULL) == SUB_USER);
+
+	printf("All host tests passed!\n");
+	return 0;
+}
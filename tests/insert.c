@@ -4,6 +4,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static int RES_OK = 0;
 static int RES_ERR_PATH_EXIST = URLROUTER_ERR_PATH_EXISTS;
@@ -15,6 +16,68 @@ static const char *ERRS[] = {
 	"MALFORMED_PATH",
 };
 
+// Check that two trees have the same shape, fragments, data and route ids
+static int same_tree(const urlrouter_node *a, const urlrouter_node *b)
+{
+	for (; a && b; a = a->next_sibling, b = b->next_sibling)
+	{
+		if (a->kind != b->kind || a->frag_len != b->frag_len || a->data != b->data ||
+			(a->data && a->id != b->id) || memcmp(a->frag, b->frag, a->frag_len) != 0 ||
+			!same_tree(a->first_child, b->first_child))
+			return 0;
+	}
+	return a == b;
+}
+
+// Write a path matching `route` in `out`, with "v" as param values
+static void concrete(const char *route, char *out)
+{
+	while (*route)
+	{
+		if ((route[0] == '{' && route[1] == '{') || (route[0] == '}' && route[1] == '}'))
+		{
+			*out++ = *route;
+			route += 2;
+		}
+		else if (*route == '{')
+		{
+			*out++ = 'v';
+			while (*route && *route++ != '}')
+				;
+		}
+		else
+			*out++ = *route++;
+	}
+	*out = '\0';
+}
+
+// Check that two routers find the same routes and params for the given routes
+static int same_lookups(const urlrouter *a, const urlrouter *b, const char **routes, size_t n)
+{
+	for (size_t i = 0; i < n * 2; i++)
+	{
+		// Each route is looked up as written and with its params replaced
+		char path[256];
+		const char *p = routes[i / 2];
+		if (i % 2)
+		{
+			concrete(p, path);
+			p = path;
+		}
+		urlparam pa[8], pb[8];
+		unsigned int cnt_a = 0, cnt_b = 0;
+		if (urlrouter_find_id(a, p, pa, 8, &cnt_a) != urlrouter_find_id(b, p, pb, 8, &cnt_b) ||
+			cnt_a != cnt_b)
+			return 0;
+		for (unsigned int j = 0; j < cnt_a && j < 8; j++)
+		{
+			if (pa[j].value != pb[j].value || pa[j].len != pb[j].len)
+				return 0;
+		}
+	}
+	return 1;
+}
+
 #define INSERT_TEST(name, ...)                                                                     \
 	static void name(void)                                                                         \
 	{                                                                                              \
@@ -40,6 +103,57 @@ static const char *ERRS[] = {
 			}                                                                                      \
 		}                                                                                          \
 		urlrouter_print(&router);                                                                  \
+		const char *paths[n / 2];                                                                  \
+		const void *data[n / 2];                                                                   \
+		int errs[n / 2];                                                                           \
+		for (size_t i = 0; i < n; i += 2)                                                          \
+		{                                                                                          \
+			paths[i / 2] = (const char *)routes[i];                                                \
+			data[i / 2] = (const void *)1;                                                         \
+		}                                                                                          \
+		urlrouter built = {0};                                                                     \
+		char build_buf[1024 * 4] = {0};                                                            \
+		urlrouter_init(&built, build_buf, 1024 * 4);                                               \
+		if (urlrouter_build(&built, paths, data, n / 2, errs) < 0)                                 \
+		{                                                                                          \
+			fprintf(stderr, "Test %s failed: build error\n", #name);                               \
+			exit(1);                                                                               \
+		}                                                                                          \
+		for (size_t i = 0; i < n / 2; i++)                                                         \
+		{                                                                                          \
+			const unsigned int expected = *(unsigned int *)routes[i * 2 + 1];                      \
+			if (expected != (unsigned int)errs[i])                                                 \
+			{                                                                                      \
+				urlrouter_print(&built);                                                           \
+				fprintf(stderr, "Test %s failed: build %s, expected %s, found: %s\n", #name,       \
+						paths[i], ERRS[-expected], ERRS[-errs[i]]);                                \
+				exit(1);                                                                           \
+			}                                                                                      \
+		}                                                                                          \
+		if (built.cursor > router.cursor || built.route_cnt != router.route_cnt)                   \
+		{                                                                                          \
+			fprintf(stderr, "Test %s failed: build uses %lu bytes, add uses %lu\n", #name,         \
+					built.cursor, router.cursor);                                                  \
+			exit(1);                                                                               \
+		}                                                                                          \
+		/* Only the order of the static siblings differs from the add tree */                     \
+		if (!same_lookups(&router, &built, paths, n / 2))                                          \
+		{                                                                                          \
+			urlrouter_print(&built);                                                               \
+			fprintf(stderr, "Test %s failed: build lookups differ from add\n", #name);             \
+			exit(1);                                                                               \
+		}                                                                                          \
+		urlrouter parallel = {0};                                                                  \
+		char parallel_buf[1024 * 4] = {0};                                                         \
+		urlrouter_init(&parallel, parallel_buf, 1024 * 4);                                         \
+		if (urlrouter_build_parallel(&parallel, paths, data, n / 2, errs, 4) < 0 ||                \
+			!same_tree(built.root, parallel.root) ||                                               \
+			!same_lookups(&router, &parallel, paths, n / 2))                                       \
+		{                                                                                          \
+			urlrouter_print(&parallel);                                                            \
+			fprintf(stderr, "Test %s failed: parallel build differs\n", #name);                    \
+			exit(1);                                                                               \
+		}                                                                                          \
 	}
 
 // clang-format off
@@ -207,6 +321,54 @@ INSERT_TEST(prefix_param_conflict,
 	"/c/{x}",										&RES_OK,
 )
 
+// The build orders the static siblings by byte, the lookups must not depend on it
+INSERT_TEST(sibling_order,
+	"/b",											&RES_OK,
+	"/a",											&RES_OK,
+	"/b/{x}",										&RES_OK,
+	"/a/{y}",										&RES_OK,
+	"/{z}",											&RES_OK,
+	"/ab",											&RES_OK,
+)
+
+// A build merged into a non-empty router keeps the routes that fit
+static void build_full(void)
+{
+	printf("\nTesting build_full:\n");
+	static char paths[64][16];
+	const char *routes[64];
+	const void *data[64];
+	int errs[64];
+	for (int i = 0; i < 64; i++)
+	{
+		snprintf(paths[i], sizeof(paths[i]), "/r%d/{id}", i);
+		routes[i] = data[i] = paths[i];
+	}
+	urlrouter router;
+	char buf[1024];
+	urlrouter_init(&router, buf, sizeof(buf));
+	urlrouter_add(&router, "/", buf);
+	if (urlrouter_build(&router, routes, data, 64, errs) != URLROUTER_ERR_BUFF_FULL)
+	{
+		fprintf(stderr, "Test build_full failed: the routes fit\n");
+		exit(1);
+	}
+	unsigned int added = router.route_cnt - 1;
+	printf("\t%u routes added\n", added);
+	for (unsigned int i = 0; i < 64; i++)
+	{
+		char path[16];
+		snprintf(path, sizeof(path), "/r%u/1", i);
+		const void *found = urlrouter_find(&router, path, NULL, 0, NULL);
+		if (i < added ? errs[i] != 0 || found != paths[i]
+					  : errs[i] != URLROUTER_ERR_BUFF_FULL || found != NULL)
+		{
+			fprintf(stderr, "Test build_full failed: %s, error %d\n", paths[i], errs[i]);
+			exit(1);
+		}
+	}
+}
+
 int main(void)
 {
 	wildcard_conflict();
@@ -222,6 +384,8 @@ int main(void)
 	no_leading_slash();
 	trailing_slash();
 	prefix_param_conflict();
+	sibling_order();
+	build_full();
 
 	return 0;
 }
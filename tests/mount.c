@@ -0,0 +1,303 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+static const char *sub_routes[] = {
+	"/users", "/users/{id}", "/users/{id}/posts/{post}", "/users/me", "/health",
+	"/{{raw}}/x", "/files/{name}", "/",
+};
+#define SUB_CNT (sizeof(sub_routes) / sizeof(sub_routes[0]))
+
+static const char *prefixes[] = {"/api/v1", "/api/v2", "/api/beta", "/tenant/{t}/api", "/v{n}"};
+#define PREFIX_CNT (sizeof(prefixes) / sizeof(prefixes[0]))
+
+// Routes of the router the sub-router is mounted in
+static const char *own_routes[] = {"/api/v1", "/api/status", "/tenant/{t}", "/"};
+#define OWN_CNT (sizeof(own_routes) / sizeof(own_routes[0]))
+
+// Look up `path` in both routers with each lookup and compare
+static void check_same(const urlrouter *router, const urlrouter *flat, const char *path)
+{
+	urlparam expected[8], params[8];
+	unsigned int expected_cnt = 0, param_cnt = 0;
+	const void *data = urlrouter_find(flat, path, expected, 8, &expected_cnt);
+	CHECK(urlrouter_find(router, path, params, 8, &param_cnt) == data);
+	if (data != NULL)
+	{
+		CHECK(param_cnt == expected_cnt);
+		for (unsigned int i = 0; i < param_cnt; i++)
+			CHECK(params[i].value == expected[i].value && params[i].len == expected[i].len);
+	}
+	CHECK(urlrouter_exists(router, path) == (data != NULL));
+	CHECK(urlrouter_find_noparams(router, path) == data);
+
+	param_cnt = 0;
+	CHECK(router->max_params <= 8);
+	CHECK(urlrouter_find_fixed(router, path, params, &param_cnt) == data);
+
+	urlrouter_matcher m;
+	urlrouter_match_begin(&m, router);
+	unsigned long len = strlen(path);
+	urlrouter_match_feed(&m, path, len / 2);
+	urlrouter_match_feed(&m, path + len / 2, len - len / 2);
+	CHECK(urlrouter_match_end(&m, NULL, 0, NULL) == data);
+}
+
+// The sub-router is mounted under each prefix and compared with a router where the routes are
+// added with their prefix
+static void check_mounts(void)
+{
+	static char sub_buf[4096], buf[4096], flat_buf[32768];
+	static char full[PREFIX_CNT][SUB_CNT][64];
+	urlrouter sub, router, flat;
+	urlrouter_init(&sub, sub_buf, sizeof(sub_buf));
+	urlrouter_init(&router, buf, sizeof(buf));
+	urlrouter_init(&flat, flat_buf, sizeof(flat_buf));
+	for (unsigned long i = 0; i < SUB_CNT; i++)
+		CHECK(urlrouter_add(&sub, sub_routes[i], sub_routes[i]) >= 0);
+
+	// The own routes are added before and after the mounts
+	for (unsigned long i = 0; i < OWN_CNT / 2; i++)
+	{
+		CHECK(urlrouter_add(&router, own_routes[i], own_routes[i]) >= 0);
+		CHECK(urlrouter_add(&flat, own_routes[i], own_routes[i]) >= 0);
+	}
+	for (unsigned long i = 0; i < PREFIX_CNT; i++)
+	{
+		CHECK(urlrouter_mount(&router, prefixes[i], &sub) >= 0);
+		for (unsigned long j = 0; j < SUB_CNT; j++)
+		{
+			snprintf(full[i][j], sizeof(full[i][j]), "%s%s", prefixes[i], sub_routes[j]);
+			CHECK(urlrouter_add(&flat, full[i][j], sub_routes[j]) >= 0);
+		}
+	}
+	for (unsigned long i = OWN_CNT / 2; i < OWN_CNT; i++)
+	{
+		CHECK(urlrouter_add(&router, own_routes[i], own_routes[i]) >= 0);
+		CHECK(urlrouter_add(&flat, own_routes[i], own_routes[i]) >= 0);
+	}
+	CHECK(router.max_params == flat.max_params);
+	CHECK(router.route_cnt == OWN_CNT);
+
+	// The nodes of the sub-router are shared
+	CHECK(router.cursor * 4 < flat.cursor);
+
+	char path[256];
+	for (unsigned long i = 0; i < 20000; i++)
+	{
+		unsigned long k = rand() % (PREFIX_CNT * SUB_CNT + OWN_CNT);
+		if (k < OWN_CNT)
+			instantiate(own_routes[k], path, PARAM_CHARS);
+		else
+			instantiate(full[(k - OWN_CNT) / SUB_CNT][(k - OWN_CNT) % SUB_CNT], path, PARAM_CHARS);
+		check_same(&router, &flat, path);
+
+		// Truncated, extended or changed
+		unsigned long len = strlen(path);
+		if (rand() % 2)
+			path[rand() % (len + 1)] = '\0';
+		else if (len + 2 < sizeof(path))
+		{
+			path[len] = "/ax"[rand() % 3];
+			path[len + 1] = '\0';
+		}
+		path[rand() % (strlen(path) + 1)] ^= rand() % 2 ? 0 : 1;
+		check_same(&router, &flat, path);
+	}
+
+	// The params of the prefix come first, the names are the ones of the sub-router
+	urlparam params[8];
+	urlrouter_match match;
+	CHECK(urlrouter_find_match(&router, NULL, "/tenant/acme/api/users/7/posts/9", params, 8,
+							   &match) == sub_routes[2]);
+	CHECK(match.router == &sub && match.route == 2 && match.param_cnt == 2);
+	CHECK(match.params == params + 1 && param_is(&params[0], "acme"));
+	CHECK(param_is(urlrouter_param_get(&match, "id"), "7"));
+	CHECK(param_is(urlrouter_param_get(&match, "post"), "9"));
+	CHECK(urlrouter_param_get(&match, "t") == NULL);
+
+	// Each route takes the next id and each mount the next ids of its routes, in the order
+	// they were added
+	const unsigned int id_cnt = OWN_CNT + PREFIX_CNT * SUB_CNT, mounted = PREFIX_CNT * SUB_CNT;
+	CHECK(urlrouter_id_cnt(&router) == id_cnt);
+	for (unsigned int id = 0; id < id_cnt; id++)
+	{
+		const unsigned int k = id - OWN_CNT / 2;
+		if (id < OWN_CNT / 2)
+			instantiate(own_routes[id], path, PARAM_CHARS);
+		else if (k < mounted)
+			instantiate(full[k / SUB_CNT][k % SUB_CNT], path, PARAM_CHARS);
+		else
+			instantiate(own_routes[id - mounted], path, PARAM_CHARS);
+		CHECK(urlrouter_find_id(&router, path, NULL, 0, NULL) == (int)id);
+		CHECK(urlrouter_find_match(&router, NULL, path, params, 8, &match) != NULL);
+		CHECK(match.id == id);
+
+		// The own routes have the same ids with urlrouter_url_for
+		char url[256];
+		if (match.router == &router)
+		{
+			CHECK(match.route == id);
+			CHECK(urlrouter_url_for(&router, id, match.params, match.param_cnt, url,
+									sizeof(url)) > 0);
+			CHECK(strcmp(url, path) == 0);
+		}
+		else
+			CHECK(urlrouter_url_for(&router, id, params, 8, url, sizeof(url)) ==
+				  URLROUTER_ERR_NOT_FOUND);
+	}
+	CHECK(urlrouter_find_id(&router, "/api/v3", NULL, 0, NULL) == URLROUTER_ERR_NOT_FOUND);
+
+	// With nested mounts, the ids of each mounted router follow the ones of its owner
+	char outer_buf[512];
+	urlrouter outer;
+	urlrouter_init(&outer, outer_buf, sizeof(outer_buf));
+	CHECK(urlrouter_add(&outer, "/own", "own") >= 0);
+	CHECK(urlrouter_mount(&outer, "/sub", &sub) >= 0);
+	CHECK(urlrouter_mount(&outer, "/router", &router) >= 0);
+	CHECK(urlrouter_id_cnt(&outer) == 1 + SUB_CNT + id_cnt);
+	CHECK(urlrouter_find_id(&outer, "/own", NULL, 0, NULL) == 0);
+	CHECK(urlrouter_find_id(&outer, "/sub/users", NULL, 0, NULL) == 1);
+	CHECK(urlrouter_find_id(&outer, "/router/api/status", NULL, 0, NULL) == 1 + SUB_CNT + 1);
+	CHECK(urlrouter_find_id(&outer, "/router/v7/health", NULL, 0, NULL) ==
+		  (int)(1 + SUB_CNT + OWN_CNT / 2 + 4 * SUB_CNT + 4));
+
+	// A route added after the mounts takes the next id, the others don't move
+	CHECK(urlrouter_add(&outer, "/later", "later") >= 0);
+	CHECK(urlrouter_id_cnt(&outer) == 2 + SUB_CNT + id_cnt);
+	CHECK(urlrouter_find_id(&outer, "/later", NULL, 0, NULL) == (int)(1 + SUB_CNT + id_cnt));
+	CHECK(urlrouter_find_id(&outer, "/sub/users", NULL, 0, NULL) == 1);
+	CHECK(urlrouter_find_id(&outer, "/router/v7/health", NULL, 0, NULL) ==
+		  (int)(1 + SUB_CNT + OWN_CNT / 2 + 4 * SUB_CNT + 4));
+	char url[16];
+	CHECK(urlrouter_url_for(&outer, 1 + SUB_CNT + id_cnt, NULL, 0, url, sizeof(url)) == 6);
+	CHECK(strcmp(url, "/later") == 0);
+	CHECK(urlrouter_url_for(&outer, 1, NULL, 0, url, sizeof(url)) == URLROUTER_ERR_NOT_FOUND);
+
+	// Own routes keep their names
+	CHECK(urlrouter_find_match(&router, NULL, "/tenant/acme", params, 8, &match) ==
+		  own_routes[2]);
+	CHECK(match.router == &router && param_is(urlrouter_param_get(&match, "t"), "acme"));
+	CHECK(urlrouter_find_match(&router, NULL, "/api/v1", params, 8, &match) == own_routes[0]);
+	CHECK(match.router == &router && match.route == 0);
+
+	// The cache stores the paths found through a mount with all their params
+	urlrouter_cache cache;
+	urlrouter_cache_init(&cache);
+	for (int i = 0; i < 2; i++)
+	{
+		unsigned int param_cnt = 0;
+		CHECK(urlrouter_find_cached(&router, &cache, "/tenant/acme/api/users/7", params, 8,
+									&param_cnt) == sub_routes[1]);
+		CHECK(param_cnt == 2 && param_is(&params[0], "acme") && param_is(&params[1], "7"));
+	}
+	CHECK(cache.hits == 1);
+
+	// The filter is the same as with the routes added with their prefix
+	CHECK(memcmp(&router.filter, &flat.filter, sizeof(urlrouter_filter)) == 0);
+	CHECK(urlrouter_set_engine(&router, URLROUTER_ENGINE_DFA) == URLROUTER_ERR_MOUNTED);
+	CHECK(router.dfa == NULL);
+}
+
+static void check_errors(void)
+{
+	char sub_buf[1024], buf[2048];
+	urlrouter sub, router;
+	urlrouter_init(&sub, sub_buf, sizeof(sub_buf));
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add(&sub, "/users/{id}", "user") >= 0);
+	CHECK(urlrouter_add(&router, "/api/v1/health", "health") >= 0);
+
+	unsigned long cursor = router.cursor;
+	unsigned int generation = router.generation;
+	CHECK(urlrouter_mount(&router, "/api/v1", &sub) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_mount(&router, "/api/{v", &sub) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(urlrouter_mount(&router, "", &sub) == URLROUTER_ERR_MALFORMED_PATH);
+	CHECK(router.cursor == cursor && router.generation == generation);
+
+	CHECK(urlrouter_mount(&router, "/api/v2", &sub) >= 0);
+	CHECK(urlrouter_mount(&router, "/api/v2", &sub) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_mount(&router, "/api", &sub) == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_add(&router, "/api/v2/users", "users") == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_add(&router, "/api/v2x", "v2x") == URLROUTER_ERR_PATH_EXISTS);
+	CHECK(urlrouter_add(&router, "/api/v2", "v2") >= 0);
+	CHECK(urlrouter_find(&router, "/api/v2", NULL, 0, NULL) != NULL);
+	CHECK(urlrouter_find(&router, "/api/v2/users/1", NULL, 0, NULL) != NULL);
+	CHECK(ur_filter_rejects(&router.filter, "/wp-admin"));
+	CHECK(!ur_filter_rejects(&router.filter, "/api/v2/users/1"));
+
+	// Splitting the prefix node keeps the mount on its lower part
+	CHECK(urlrouter_mount(&router, "/api/v30", &sub) >= 0);
+	CHECK(urlrouter_add(&router, "/api/v3", "v3") >= 0);
+	CHECK(urlrouter_add(&router, "/api/v3/users", "users") >= 0);
+	urlrouter_match match;
+	CHECK(urlrouter_find_match(&router, NULL, "/api/v30/users/1", NULL, 0, &match) != NULL);
+	CHECK(match.router == &sub);
+	CHECK(urlrouter_find(&router, "/api/v3/users", NULL, 0, NULL) != NULL);
+	CHECK(urlrouter_add(&router, "/api/v30/users", "users") == URLROUTER_ERR_PATH_EXISTS);
+
+	// Mounting an empty router links nothing
+	urlrouter empty;
+	urlrouter_init(&empty, NULL, 0);
+	urlrouter_filter filter = router.filter;
+	CHECK(urlrouter_mount(&router, "/empty", &empty) >= 0);
+	CHECK(memcmp(&filter, &router.filter, sizeof(filter)) == 0);
+	CHECK(urlrouter_find(&router, "/empty", NULL, 0, NULL) == NULL);
+
+	// A full buffer leaves the router as it was
+	char small_buf[160];
+	urlrouter small;
+	urlrouter_init(&small, small_buf, sizeof(small_buf));
+	int err = 0;
+	for (int i = 0; err >= 0; i++)
+	{
+		cursor = small.cursor;
+		err = urlrouter_mount(&small, prefixes[i % 2], &sub);
+	}
+	CHECK(err == URLROUTER_ERR_BUFF_FULL && small.cursor == cursor);
+	CHECK(urlrouter_find(&small, "/api/v1/users/1", NULL, 0, NULL) != NULL);
+}
+
+// A mounted router can have mounts too
+static void check_nested(void)
+{
+	char users_buf[1024], api_buf[1024], buf[1024];
+	urlrouter users, api, router;
+	urlrouter_init(&users, users_buf, sizeof(users_buf));
+	urlrouter_init(&api, api_buf, sizeof(api_buf));
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add(&users, "/{id}", "user") >= 0);
+	CHECK(urlrouter_add(&api, "/health", "health") >= 0);
+	CHECK(urlrouter_mount(&api, "/users", &users) >= 0);
+	CHECK(urlrouter_mount(&router, "/{tenant}/v1", &api) >= 0);
+	CHECK(urlrouter_mount(&router, "/{tenant}/v2", &api) >= 0);
+	CHECK(router.max_params == 2);
+
+	urlparam params[4];
+	urlrouter_match match;
+	CHECK(urlrouter_find_match(&router, NULL, "/acme/v2/users/42", params, 4, &match) != NULL);
+	CHECK(match.router == &users && match.param_cnt == 1 && param_is(&params[0], "acme"));
+	CHECK(param_is(urlrouter_param_get(&match, "id"), "42"));
+	CHECK(urlrouter_find_match(&router, NULL, "/acme/v1/health", params, 4, &match) != NULL);
+	CHECK(match.router == &api && match.param_cnt == 0);
+
+	// Fewer params than the prefix has
+	CHECK(urlrouter_find_match(&router, NULL, "/acme/v1/users/42", params, 0, &match) != NULL);
+	CHECK(match.router == &users && match.param_cnt == 0);
+	CHECK(urlrouter_param_get(&match, "id") == NULL);
+}
+
+int main(void)
+{
+	srand(5);
+	check_mounts();
+	check_errors();
+	check_nested();
+	printf("All mount tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,101 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+static void check_match(const urlrouter *router)
+{
+	urlparam params[8];
+	urlrouter_match match;
+
+	CHECK(urlrouter_find_match(router, NULL, "/users/42/posts/7", params, 8, &match) != NULL);
+	CHECK(match.route == 1 && match.param_cnt == 2);
+	CHECK(param_is(urlrouter_param_get(&match, "id"), "42"));
+	CHECK(param_is(urlrouter_param_get(&match, "post"), "7"));
+	CHECK(urlrouter_param_get(&match, "name") == NULL);
+
+	// The same name can be at another position in another route
+	CHECK(urlrouter_find_match(router, NULL, "/orgs/acme/users/42", params, 8, &match) != NULL);
+	CHECK(param_is(urlrouter_param_get(&match, "org"), "acme"));
+	CHECK(param_is(urlrouter_param_get(&match, "id"), "42"));
+
+	// Precomputed keys
+	static unsigned int org_key;
+	if (org_key == 0)
+		org_key = urlrouter_param_key("org");
+	CHECK(param_is(urlrouter_param_get_key(&match, org_key), "acme"));
+
+	// Params that did not fit in the array
+	CHECK(urlrouter_find_match(router, NULL, "/orgs/acme/users/42", params, 1, &match) != NULL);
+	CHECK(param_is(urlrouter_param_get(&match, "org"), "acme"));
+	CHECK(urlrouter_param_get(&match, "id") == NULL);
+
+	// Routes without params and misses
+	CHECK(urlrouter_find_match(router, NULL, "/users", params, 8, &match) != NULL);
+	CHECK(urlrouter_param_get(&match, "id") == NULL);
+	CHECK(urlrouter_find_match(router, NULL, "/nope", params, 8, &match) == NULL);
+	CHECK(urlrouter_param_get(&match, "id") == NULL);
+
+	// A name used twice gives its first value
+	CHECK(urlrouter_find_match(router, NULL, "/twice/1/2", params, 8, &match) != NULL);
+	CHECK(param_is(urlrouter_param_get(&match, "id"), "1"));
+
+	// Host params are named too
+	CHECK(urlrouter_find_match(router, "acme.example.com", "/a/b/c/d/e/f", params, 8, &match));
+	CHECK(param_is(urlrouter_param_get(&match, "sub"), "acme"));
+	CHECK(param_is(urlrouter_param_get(&match, "p1"), "a"));
+	CHECK(param_is(urlrouter_param_get(&match, "p6"), "f"));
+}
+
+int main(void)
+{
+	static const char *routes[] = {
+		"/users",
+		"/users/{id}/posts/{post}",
+		"/orgs/{org}/users/{id}",
+		"/twice/{id}/{id}",
+	};
+	const unsigned long n = sizeof(routes) / sizeof(routes[0]);
+	char buf[4096];
+	urlrouter router;
+
+	urlrouter_init(&router, buf, sizeof(buf));
+	for (unsigned long i = 0; i < n; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/{p1}/{p2}/{p3}/{p4}/{p5}/{p6}", buf) >=
+		  0);
+	check_match(&router);
+
+	// urlrouter_build gives the same tables
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_build(&router, routes, (const void **)routes, n, NULL) >= 0);
+	CHECK(urlrouter_add_host(&router, "{sub}.example.com", "/{p1}/{p2}/{p3}/{p4}/{p5}/{p6}", buf) >=
+		  0);
+	check_match(&router);
+
+	// "glbvs" and "yacxa" have the same key: a route can't have both, and a lookup by the
+	// other one only finds the param by key
+	CHECK(urlrouter_param_key("glbvs") == urlrouter_param_key("yacxa"));
+	const char *colliding[] = {"/c/{glbvs}/{yacxa}", "/c/{glbvs}"};
+	int errs[2];
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_add(&router, colliding[0], buf) == URLROUTER_ERR_PARAM_COLLISION);
+	CHECK(urlrouter_add_host(&router, "{yacxa}.example.com", colliding[1], buf) ==
+		  URLROUTER_ERR_PARAM_COLLISION);
+	CHECK(urlrouter_build(&router, colliding, (const void **)colliding, 2, errs) >= 0);
+	CHECK(errs[0] == URLROUTER_ERR_PARAM_COLLISION && errs[1] == 0);
+	urlparam params[2];
+	urlrouter_match match;
+	CHECK(urlrouter_find_match(&router, NULL, "/c/x", params, 2, &match) == colliding[1]);
+	CHECK(param_is(urlrouter_param_get(&match, "glbvs"), "x"));
+	CHECK(urlrouter_param_get(&match, "yacxa") == NULL);
+	CHECK(urlrouter_param_get(&match, "glbv") == NULL);
+	CHECK(urlrouter_param_get_key(&match, urlrouter_param_key("yacxa")) == &params[0]);
+
+	printf("All params tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,199 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+#define MAX_CHUNKS 64
+
+// Copy a param out of the chunks it spans
+static void read_param(const urlrouter_chunk_param *param, const char **chunks,
+					   const unsigned long *lens, char *out)
+{
+	for (unsigned int c = param->first_chunk; c <= param->last_chunk; c++)
+	{
+		unsigned long from = c == param->first_chunk ? param->first : 0;
+		unsigned long to = c == param->last_chunk ? param->end : lens[c];
+		memcpy(out, chunks[c] + from, to - from);
+		out += to - from;
+	}
+	*out = '\0';
+}
+
+// Feed `path` cut at each of the `cut_cnt` offsets of `cuts` and compare with urlrouter_find
+static void check_cuts(const urlrouter *router, const char *path, const unsigned long *cuts,
+					   unsigned int cut_cnt)
+{
+	urlparam expected[8];
+	unsigned int expected_cnt = 0;
+	const void *data = urlrouter_find(router, path, expected, 8, &expected_cnt);
+
+	const char *chunks[MAX_CHUNKS];
+	unsigned long lens[MAX_CHUNKS], start = 0, path_len = strlen(path);
+	urlrouter_matcher m;
+	urlrouter_match_begin(&m, router);
+	for (unsigned int i = 0; i <= cut_cnt; i++)
+	{
+		unsigned long end = i < cut_cnt ? cuts[i] : path_len;
+		chunks[i] = path + start;
+		lens[i] = end - start;
+		int ret = urlrouter_match_feed(&m, chunks[i], lens[i]);
+		CHECK(ret == 0 || ret == 1);
+		start = end;
+	}
+
+	urlrouter_chunk_param params[8];
+	unsigned int param_cnt;
+	if (urlrouter_match_end(&m, params, 8, &param_cnt) != data)
+	{
+		fprintf(stderr, "%s: data differs from urlrouter_find\n", path);
+		exit(1);
+	}
+	if (data == NULL)
+		return;
+	CHECK(param_cnt == expected_cnt);
+	for (unsigned int i = 0; i < param_cnt; i++)
+	{
+		char value[64];
+		read_param(&params[i], chunks, lens, value);
+		CHECK(params[i].len == expected[i].len);
+		CHECK(strlen(value) == expected[i].len);
+		CHECK(memcmp(value, expected[i].value, expected[i].len) == 0);
+	}
+}
+
+static void check_path(const urlrouter *router, const char *path)
+{
+	unsigned long cuts[MAX_CHUNKS], len = strlen(path);
+	check_cuts(router, path, NULL, 0);
+
+	// Every cut in two chunks, including empty ones
+	for (unsigned long i = 0; i <= len; i++)
+	{
+		cuts[0] = i;
+		check_cuts(router, path, cuts, 1);
+	}
+
+	// One byte per chunk
+	if (len < MAX_CHUNKS)
+	{
+		for (unsigned long i = 0; i + 1 < len; i++)
+			cuts[i] = i + 1;
+		check_cuts(router, path, cuts, len > 0 ? len - 1 : 0);
+	}
+}
+
+static void check_early_miss(const urlrouter *router)
+{
+	urlrouter_matcher m;
+	urlrouter_match_begin(&m, router);
+	CHECK(urlrouter_match_feed(&m, "/us", 3) == 1);
+	CHECK(urlrouter_match_feed(&m, "ers/", 4) == 1);
+	CHECK(urlrouter_match_feed(&m, "me/se", 5) == 1);
+	CHECK(urlrouter_match_end(&m, NULL, 0, NULL) == NULL);
+
+	// No route has an empty first segment, the lookup is over after the second byte
+	urlrouter_match_begin(&m, router);
+	CHECK(urlrouter_match_feed(&m, "//", 2) == 0);
+	CHECK(urlrouter_match_feed(&m, "yz", 2) == 0);
+	CHECK(urlrouter_match_end(&m, NULL, 0, NULL) == NULL);
+
+	// Nothing fed
+	urlrouter_match_begin(&m, router);
+	CHECK(urlrouter_match_end(&m, NULL, 0, NULL) == NULL);
+}
+
+// Each level has a static and a param child matching the same bytes, so the number of
+// candidates grows with the depth
+static void check_too_many_threads(void)
+{
+	static const char *routes[] = {
+		"/a/b/c/d/e/f",
+		"/{p}/b/c/d/e/g",
+		"/{p}/{q}/c/d/e/h",
+		"/{p}/{q}/{r}/d/e/i",
+		"/{p}/{q}/{r}/{s}/e/j",
+	};
+	const unsigned long n = sizeof(routes) / sizeof(routes[0]);
+	char buf[4096];
+	urlrouter router;
+	urlrouter_init(&router, buf, sizeof(buf));
+	for (unsigned long i = 0; i < n; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+
+	urlrouter_matcher m;
+	urlrouter_match_begin(&m, &router);
+	CHECK(urlrouter_match_feed(&m, "/a/b/c/d/e/f", 12) == URLROUTER_ERR_BUFF_FULL);
+	CHECK(urlrouter_match_end(&m, NULL, 0, NULL) == NULL);
+
+	// Shorter paths fit
+	check_path(&router, "/a/b/x");
+	check_path(&router, "/z/b/c/d/e/g");
+}
+
+int main(void)
+{
+	static const char *routes[] = {
+		"/users",
+		"/users/{id}",
+		"/users/{id}/posts/{post}",
+		"/users/me",
+		"/users/me/settings",
+		"/users/api/keys",
+		"/orgs/{org}/users/{id}",
+		"/src/{file}",
+		"/static/app.js",
+		"/{lang}/docs",
+		"/",
+	};
+	static const char *paths[] = {
+		"/users",
+		"/users/",
+		"/users/42",
+		"/users/me",
+		"/users/mex",
+		"/users/me/settings",
+		"/users/me/posts/7",
+		"/users/api",
+		"/users/api/keys",
+		"/users/apx/posts/1",
+		"/users/42/posts/7",
+		"/users/42/posts/",
+		"/users//posts/x",
+		"/orgs/acme/users/abcdefghij",
+		"/src/a.c",
+		"/src/",
+		"/src",
+		"/static/app.js",
+		"/static/docs",
+		"/fr/docs",
+		"/",
+		"//",
+		"/nope",
+		"",
+	};
+	const unsigned long n = sizeof(routes) / sizeof(routes[0]);
+	char buf[8192];
+	urlrouter router;
+
+	urlrouter_init(&router, buf, sizeof(buf));
+	for (unsigned long i = 0; i < n; i++)
+		CHECK(urlrouter_add(&router, routes[i], routes[i]) >= 0);
+	for (unsigned long i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+		check_path(&router, paths[i]);
+	check_early_miss(&router);
+
+	// urlrouter_build gives the same tree
+	urlrouter_init(&router, buf, sizeof(buf));
+	CHECK(urlrouter_build(&router, routes, (const void **)routes, n, NULL) >= 0);
+	for (unsigned long i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+		check_path(&router, paths[i]);
+
+	check_too_many_threads();
+
+	printf("All stream tests passed!\n");
+	return 0;
+}
@@ -0,0 +1,105 @@
+#define URLROUTER_ASSERT
+#include "urlrouter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+static const char *ROUTES[] = {
+	"/users",
+	"/users/{id}",
+	"/users/{id}/posts/{post}",
+	"/users/{id}",
+	"/raw/{{id}}/{name}",
+	"/bad/{id",
+};
+
+static void check_url(const urlrouter *router, unsigned int route, const urlparam *params,
+					  unsigned int n, const char *expected)
+{
+	char out[64];
+	int len = urlrouter_url_for(router, route, params, n, out, sizeof(out));
+	if (len != (int)strlen(expected) || strcmp(out, expected) != 0)
+	{
+		fprintf(stderr, "url_for(%u) = %d \"%s\", expected \"%s\"\n", route, len, len < 0 ? "" : out,
+				expected);
+		exit(1);
+	}
+}
+
+static void test_url_for(const urlrouter *router)
+{
+	urlparam params[] = {{"42", 2}, {"hello-world", 11}};
+	char out[16];
+
+	// Rejected routes don't get an id
+	CHECK(router->route_cnt == 4);
+	check_url(router, 0, NULL, 0, "/users");
+	check_url(router, 1, params, 2, "/users/42");
+	check_url(router, 2, params, 2, "/users/42/posts/hello-world");
+	check_url(router, 3, params + 1, 1, "/raw/{id}/hello-world");
+
+	// The needed length is returned when the url does not fit
+	memcpy(out, "untouched", 10);
+	CHECK(urlrouter_url_for(router, 2, params, 2, out, sizeof(out)) == 27);
+	CHECK(strcmp(out, "untouched") == 0);
+	CHECK(urlrouter_url_for(router, 0, NULL, 0, out, 6) == 6);
+	CHECK(strcmp(out, "untouched") == 0);
+	CHECK(urlrouter_url_for(router, 0, NULL, 0, out, 7) == 6);
+	CHECK(strcmp(out, "/users") == 0);
+
+	CHECK(urlrouter_url_for(router, 2, params, 1, out, sizeof(out)) == URLROUTER_ERR_MISSING_PARAM);
+	CHECK(urlrouter_url_for(router, 4, params, 2, out, sizeof(out)) == URLROUTER_ERR_NOT_FOUND);
+}
+
+// The lookups give the ids of url_for, also with the DFA
+static void test_find_id(urlrouter *router)
+{
+	// Without mounts, there is one id per route
+	CHECK(urlrouter_id_cnt(router) == router->route_cnt);
+	for (int engine = URLROUTER_ENGINE_TREE; engine <= URLROUTER_ENGINE_DFA; engine++)
+	{
+		CHECK(urlrouter_set_engine(router, engine) >= 0);
+		urlparam params[2];
+		unsigned int cnt = 0;
+		CHECK(urlrouter_find_id(router, "/users", NULL, 0, NULL) == 0);
+		CHECK(urlrouter_find_id(router, "/users/42", params, 2, &cnt) == 1);
+		CHECK(cnt == 1 && params[0].len == 2);
+		CHECK(urlrouter_find_id(router, "/users/42/posts/x", NULL, 0, NULL) == 2);
+		CHECK(urlrouter_find_id(router, "/raw/{id}/x", NULL, 0, NULL) == 3);
+		CHECK(urlrouter_find_id(router, "/raw/x/x", NULL, 0, NULL) == URLROUTER_ERR_NOT_FOUND);
+		CHECK(urlrouter_find_id(router, "/users/", NULL, 0, NULL) == URLROUTER_ERR_NOT_FOUND);
+	}
+	CHECK(urlrouter_set_engine(router, URLROUTER_ENGINE_TREE) >= 0);
+}
+
+int main(void)
+{
+	const unsigned long n = sizeof(ROUTES) / sizeof(ROUTES[0]);
+	const void **data = (const void **)ROUTES;
+	char buf[16384];
+	urlrouter router;
+
+	urlrouter_init(&router, buf, sizeof(buf));
+	for (unsigned long i = 0; i < n; i++)
+		urlrouter_add(&router, ROUTES[i], data[i]);
+	test_url_for(&router);
+	test_find_id(&router);
+
+	// urlrouter_build gives the same ids
+	urlrouter_init(&router, buf, sizeof(buf));
+	urlrouter_build(&router, ROUTES, data, n, NULL);
+	test_url_for(&router);
+	test_find_id(&router);
+
+	// A route that can't be inserted doesn't keep its id
+	urlrouter_init(&router, buf, 4 * sizeof(urlrouter_node));
+	CHECK(urlrouter_add(&router, "/a/{b}", NULL) >= 0);
+	CHECK(urlrouter_add(&router, "/c/very/long/route/{with}/{params}", NULL) == URLROUTER_ERR_BUFF_FULL);
+	CHECK(router.route_cnt == 1);
+
+	printf("All url_for tests passed!\n");
+	return 0;
+}
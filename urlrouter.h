@@ -31,10 +31,24 @@
 #define NULL 0
 #endif
 
+// With URLROUTER_IMPLEMENTATION defined, the implementation is included as static inline
+// functions so that the compiler can inline and specialize the lookups in the caller.
+// Otherwise link with urlrouter.c.
+#ifndef URLROUTER_API
+#ifdef URLROUTER_IMPLEMENTATION
+#define URLROUTER_API static inline
+#else
+#define URLROUTER_API
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+	struct urlrouter_dfa;
+	struct urlrouter_mount;
+
 	enum
 	{
 		// The provided path already exists in the router
@@ -44,42 +58,181 @@ extern "C"
 		URLROUTER_ERR_BUFF_FULL = -2,
 
 		// Path parameter is not closed or contains non alphanumeric characters
-		URLROUTER_ERR_MALFORMED_PATH = -3
+		URLROUTER_ERR_MALFORMED_PATH = -3,
+
+		// There is no route with the given id
+		URLROUTER_ERR_NOT_FOUND = -4,
+
+		// Less params than the route has were given
+		URLROUTER_ERR_MISSING_PARAM = -5,
+
+		// The router has mounts, which the DFA engine does not support
+		URLROUTER_ERR_MOUNTED = -6,
+
+		// Two different param names of the route have the same key, see urlrouter_param_key
+		URLROUTER_ERR_PARAM_COLLISION = -7
 	};
 
 	static const char *URLROUTER_ERRS_STR[] = {
 		"OK",
 		"Path already exists",
 		"Buffer is full",
-		"Malformed path"
+		"Malformed path",
+		"Route not found",
+		"Missing parameter",
+		"Not supported with mounts",
+		"Param names with the same key"
 	};
 
 	static inline const char* urlrouter_get_error_str(int err)
 	{
-		if (err >= 0 || err < -(int)sizeof(URLROUTER_ERRS_STR))
+		if (err >= 0 || err <= -(int)(sizeof(URLROUTER_ERRS_STR) / sizeof(URLROUTER_ERRS_STR[0])))
 			return NULL;
 		return URLROUTER_ERRS_STR[-err];
 	}
 
+	enum
+	{
+		// The node matches its fragment byte by byte
+		URLROUTER_NODE_STATIC = 0,
+
+		// The node matches a param, its fragment is the name of the param
+		URLROUTER_NODE_PARAM = 1
+	};
+
 	typedef struct urlrouter_node
 	{
-		int dead : 1;
+		// A slice of the route. Escaped braces are already unescaped: a static fragment ends
+		// at the first brace of a `{{` or `}}` and the second one is skipped.
 		const char *frag;
 		unsigned int frag_len : 7; // max frag 127
+		unsigned int kind : 1;
+		// Set on the node where a mount prefix ends, its children are the root nodes of the
+		// mounted router
+		unsigned int mount : 1;
+		// Id of the route ending at this node, only meaningful if data is set
+		unsigned int id;
 		const void *data;
 		struct urlrouter_node *first_child;
 		struct urlrouter_node *next_sibling;
 	} urlrouter_node;
 
+	/**
+	 * A piece of a route template: either a literal slice of the route, with escaped
+	 * braces already unescaped, or a parameter in which case `str` is its name.
+	 */
+	typedef struct
+	{
+		const char *str;
+		unsigned int len : 31;
+		unsigned int is_param : 1;
+	} urlrouter_piece;
+
+	/**
+	 * An entry of the param name table of a route: the key of a param name, its position
+	 * in the route plus one, 0 for an empty slot, and the piece holding its name.
+	 */
+	typedef struct
+	{
+		unsigned int key;
+		unsigned int index;
+		unsigned int piece;
+	} urlrouter_param_slot;
+
+	/**
+	 * A route compiled when it is added, used to generate its urls and to find its
+	 * params by name. The pieces are followed by an open addressing table of
+	 * `slot_mask + 1` urlrouter_param_slot indexed by the key of the param names.
+	 */
+	typedef struct
+	{
+		const urlrouter_piece *pieces;
+		unsigned short piece_cnt;
+		unsigned short param_cnt;
+		unsigned short slot_mask;
+		// Length of the literal pieces
+		unsigned int len;
+		// Id of the route, see urlrouter_find_id
+		unsigned int id;
+	} urlrouter_route;
+
+#ifndef URLROUTER_FILTER_BITS
+// Size of the bloom filter of urlrouter_filter, a power of two
+#define URLROUTER_FILTER_BITS 512
+#endif
+// Number of leading bytes of the paths checked by urlrouter_filter, read as one word
+#define URLROUTER_FILTER_PREFIX 4
+
+	/**
+	 * A summary of the routes added without host, checked before walking the tree so that
+	 * most paths that can't match are rejected after a few instructions. It never rejects
+	 * a path that matches a route.
+	 */
+	typedef struct
+	{
+		// Bloom filter of the first URLROUTER_FILTER_PREFIX bytes of the routes
+		unsigned int prefixes[URLROUTER_FILTER_BITS / 32];
+		// Bloom filter of the routes with a param in their prefix, keyed by their first
+		// URLROUTER_FILTER_PREFIX bytes after the '/' that ends the param
+		unsigned int param_prefixes[URLROUTER_FILTER_BITS / 32];
+		// Set when a route has a param in its prefix, and when one of them has no '/' after it
+		unsigned int param_led;
+		unsigned int param_leaf;
+		// Set when a route can't be summarized, any prefix can match. It happens for a param
+		// after a '/' in the first bytes, like "/a/{id}", for fewer than
+		// URLROUTER_FILTER_PREFIX literal bytes after the param, like "/{lang}/{id}", and for
+		// a mount prefix shorter than that, like "/", whose first bytes come from the sub router.
+		unsigned int any_prefix;
+		// Length of the shortest and of the longest paths that can match a route
+		unsigned int min_len;
+		unsigned int max_len;
+	} urlrouter_filter;
+
+	/**
+	 * Callbacks giving more memory to a router when its buffer is full, see
+	 * urlrouter_set_allocator.
+	 */
+	typedef struct
+	{
+		// Return a chunk of at least `size` bytes aligned for pointers, or NULL
+		void *(*alloc)(void *user, unsigned long size);
+		// Release a chunk given by `alloc`, can be NULL if the chunks are released otherwise
+		void (*free)(void *user, void *chunk, unsigned long size);
+		void *user;
+		// Size of the chunks, an operation needing more is retried with twice the size
+		unsigned long chunk_size;
+	} urlrouter_allocator;
+
 	typedef struct
 	{
 		urlrouter_node *root;
+		// Root of the routes added with urlrouter_add_host
+		urlrouter_node *host_root;
 		// Data buffer
 		void *buffer;
 		// Buffer length
 		unsigned long len;
-		// Internal node cursor for the buffer
+		// Internal cursor for the buffer, nodes and templates are allocated from the start
 		unsigned long cursor;
+		// Number of routes. Their urlrouter_route are stored from the end of the buffer, in
+		// the order of their ids
+		unsigned int route_cnt;
+		// Highest number of params of a route
+		unsigned int max_params;
+		// Incremented each time routes are added, see urlrouter_cache
+		unsigned int generation;
+		urlrouter_filter filter;
+		// The DFA compiled by urlrouter_set_engine, NULL when the tree is walked
+		const struct urlrouter_dfa *dfa;
+		// The routers mounted with urlrouter_mount
+		struct urlrouter_mount *mounts;
+		// Number of ids given to the routes and to the mounted routers, see urlrouter_id_cnt
+		unsigned int id_cnt;
+		// Used when the buffer is full if `alloc` is set
+		urlrouter_allocator allocator;
+		// Number of chunks given by the allocator. The buffer is the last one, each chunk
+		// starts with a header describing the buffer used before it.
+		unsigned int chunk_cnt;
 	} urlrouter;
 
 	/**
@@ -92,13 +245,62 @@ extern "C"
 		unsigned int len;
 	} urlparam;
 
+	/**
+	 * The result of urlrouter_find_match, used to get the params by name.
+	 */
+	typedef struct
+	{
+		// The data associated with the route, NULL if not found
+		const void *data;
+		// The id of the matched route in `router`, for urlrouter_url_for
+		unsigned int route;
+		// The id of the matched route in the looked up router, the one returned by
+		// urlrouter_find_id. It differs from `route` for a route of a mounted router.
+		unsigned int id;
+		// The params given to urlrouter_find_match and the number of them that were set
+		const urlparam *params;
+		unsigned int param_cnt;
+		const urlrouter *router;
+	} urlrouter_match;
+
 	/**
 	 * @brief Initialize the router with a buffer and its size
+	 * Its generation starts at 0 again, so the caches used with a router initialized again
+	 * at the same address must be reset with urlrouter_cache_init.
 	 * @param router The router to initialize
 	 * @param buffer The buffer to store the nodes
 	 * @param len The size of the buffer
 	 */
-	void urlrouter_init(urlrouter *router, void *buffer, unsigned long len);
+	URLROUTER_API void urlrouter_init(urlrouter *router, void *buffer, unsigned long len);
+
+	/**
+	 * @brief Let the router ask `allocator` for more memory when its buffer is full, instead
+	 * of failing with URLROUTER_ERR_BUFF_FULL. The operation is then retried in a new chunk.
+	 * The chunks are linked, so the nodes already created don't move, and the route records
+	 * are moved to the end of the new chunk. The space left in the previous buffer is not
+	 * used anymore.
+	 * The buffer given to urlrouter_init can be NULL with this allocator.
+	 * The DFA of urlrouter_set_engine is only compiled in the space left in the buffer.
+	 */
+	URLROUTER_API void urlrouter_set_allocator(urlrouter *router,
+											   const urlrouter_allocator *allocator);
+
+	/**
+	 * @brief Copy the chunks given by the allocator and the buffer into a single new chunk
+	 * and release them, so that the nodes are contiguous. The pointers to the nodes, like the
+	 * ones held by a urlrouter_matcher or by a router it is mounted in, are not valid
+	 * anymore. Nothing is done without chunks.
+	 * @returns The remaining space in the buffer or URLROUTER_ERR_BUFF_FULL if the allocator
+	 * failed, in which case the router is unchanged.
+	 */
+	URLROUTER_API int urlrouter_repack(urlrouter *router);
+
+	/**
+	 * @brief Release the chunks given by the allocator. The router is then empty and uses the
+	 * buffer given to urlrouter_init again. Its generation is incremented, so the entries of
+	 * the caches used with it are not valid anymore.
+	 */
+	URLROUTER_API void urlrouter_free(urlrouter *router);
 
 	/**
 	 * @brief Add a path to the router.
@@ -106,15 +308,97 @@ extern "C"
 	 * @param path The path to add. It should be a null-terminated string that has
 	 * at least the lifetime of the router
 	 * @param data The data to associate with the path
+	 * Each added path gets the next route id, starting from 0 and skipping the ids reserved
+	 * by urlrouter_mount. It can be used with urlrouter_url_for.
 	 * @returns The remaining space in the buffer or URLROUTER_ERR_PATH_EXISTS if
 	 * path is already existing in the buffer or URLROUTER_ERR_BUFF_FULL if there is
 	 * no more room in the buffer.
 	 */
-	int urlrouter_add(urlrouter *router, const char *path, const void *data);
+	URLROUTER_API int urlrouter_add(urlrouter *router, const char *path, const void *data);
+
+	/**
+	 * @brief Add a path that only matches for the given host.
+	 * The host can contain params, like `{sub}.example.com`. A host param stops at the
+	 * next '.'. The host and the path are copied in the buffer, one after the other, so
+	 * that both are matched in a single lookup by urlrouter_find_host.
+	 * The url generated by urlrouter_url_for for this route is the host followed by
+	 * the path.
+	 * @param router The router to add the path to
+	 * @param host The host, without port. It can't contain a '/'
+	 * @param path The path to add. It must start with a '/'
+	 * @param data The data to associate with the host and path
+	 * @returns The same as urlrouter_add
+	 */
+	URLROUTER_API int urlrouter_add_host(urlrouter *router, const char *host, const char *path,
+										 const void *data);
+
+	/**
+	 * @brief Add all the given paths to the router at once.
+	 * The routes are sorted and the tree is built bottom-up in a single pass, without
+	 * any node split. It gives the same lookups as calling urlrouter_add for each route.
+	 * Below ~10k routes both take about the same time, the sort costs as much as the splits
+	 * it saves; in `make bench` it is ~1.5x faster at 50k routes and ~2x at 200k. The tree only differs by the order of the static siblings,
+	 * by byte instead of by insertion: they start with different bytes, so at most one of
+	 * them can match. If the router already contains routes, they are added
+	 * one by one with urlrouter_add.
+	 * While building, two pointers per route at the end of the buffer are used as scratch
+	 * space.
+	 * @param router The router to add the paths to
+	 * @param routes The paths to add. They should have at least the lifetime of the router
+	 * @param data The data associated with each path
+	 * @param n The number of paths
+	 * @param errs An array of `n` entries that will be set to 0 for each added path or to
+	 * URLROUTER_ERR_PATH_EXISTS / URLROUTER_ERR_MALFORMED_PATH. Can be null.
+	 * Route ids are given in the order of `routes`, skipping the rejected ones, so they
+	 * are the same as with urlrouter_add.
+	 * @returns The remaining space in the buffer or URLROUTER_ERR_BUFF_FULL if there is
+	 * no more room in the buffer. In that case no route is added to an empty router. When
+	 * the router already contains routes, the ones before the first that did not fit are
+	 * kept and the entries of `errs` from that one on are set to URLROUTER_ERR_BUFF_FULL.
+	 */
+	URLROUTER_API int urlrouter_build(urlrouter *router, const char **routes, const void **data,
+									  unsigned long n, int *errs);
+
+#ifdef URLROUTER_THREADS
+	/**
+	 * @brief Same as urlrouter_build but the routes are verified, sorted and built on
+	 * up to `threads` threads (the calling one included). The routes are partitioned
+	 * by their leading bytes and each partition is built in its own region of the buffer
+	 * before being linked to the top of the tree. The resulting tree is the same as the
+	 * one built by urlrouter_build, so the lookups are the same as with urlrouter_add.
+	 * It requires pthreads and the URLROUTER_THREADS define.
+	 */
+	URLROUTER_API int urlrouter_build_parallel(urlrouter *router, const char **routes,
+											   const void **data, unsigned long n, int *errs,
+											   unsigned int threads);
+#endif
+
+	/**
+	 * @brief Link the routes of `sub` under `prefix`, so that a path made of a match of
+	 * `prefix` followed by a match of a route of `sub` finds that route. The nodes of `sub`
+	 * are shared, not copied: mounting a router under several prefixes costs a few nodes per
+	 * prefix. The params of the prefix come first, followed by the ones of the route of
+	 * `sub`.
+	 * Only the routes of `sub` added without host are mounted. `sub` must stay at the same
+	 * address and must not be changed once mounted, and no route can be added below
+	 * `prefix` in `router`.
+	 * @param router The router to mount `sub` in
+	 * @param prefix The prefix, with the same syntax as a route
+	 * @param sub The router to mount, which can have mounts too
+	 * @returns The remaining space in the buffer or a negative error code:
+	 * - URLROUTER_ERR_PATH_EXISTS if a route of `router` starts with `prefix`
+	 * - URLROUTER_ERR_BUFF_FULL if the buffer is full
+	 * - URLROUTER_ERR_MALFORMED_PATH if `prefix` is malformed
+	 */
+	URLROUTER_API int urlrouter_mount(urlrouter *router, const char *prefix, const urlrouter *sub);
 
 	/**
 	 * @brief Find a path in the router and return its associated value and path
 	 * params.
+	 * The static nodes have priority over the params. When a static node only matches the
+	 * start of a segment, its param sibling is tried from where the static node started.
+	 * A param matches one byte or more up to the next '/', so "/src/" does not match
+	 * "/src/{file}".
 	 * @param router The router to search in
 	 * @param path A null-terminated C string to search for
 	 * @param params An array that will be populated with each encountered params.
@@ -124,18 +408,3113 @@ extern "C"
 	 * params
 	 * @returns The data associated with the path or NULL if the path is not found
 	 */
-	const void *urlrouter_find(const urlrouter *router, const char *path, urlparam *params,
-							   const unsigned int len, unsigned int *param_cnt);
+	URLROUTER_API const void *urlrouter_find(const urlrouter *router, const char *path,
+											 urlparam *params, const unsigned int len,
+											 unsigned int *param_cnt);
+
+	/**
+	 * @brief Same as urlrouter_find but return the id of the route instead of its data.
+	 * The ids are dense, so the data of the routes can be stored in arrays of
+	 * urlrouter_id_cnt entries indexed by id. The routes of the router have the ids of
+	 * urlrouter_url_for. A mount reserves the next urlrouter_id_cnt(sub) ids for the routes
+	 * of `sub`, in the order of their ids in `sub`, so an id never changes once given.
+	 * The ids only depend on the order of the routes and mounts, so a router built again
+	 * from them gives the same ids.
+	 * @returns The id of the route or URLROUTER_ERR_NOT_FOUND
+	 */
+	URLROUTER_API int urlrouter_find_id(const urlrouter *router, const char *path,
+										urlparam *params, const unsigned int len,
+										unsigned int *param_cnt);
+
+	/**
+	 * @brief Get the number of ids urlrouter_find_id can return: the routes of the router
+	 * and the ones of the routers mounted in it.
+	 */
+	URLROUTER_API unsigned int urlrouter_id_cnt(const urlrouter *router);
+
+	/**
+	 * @brief Same as urlrouter_find without params.
+	 */
+	URLROUTER_API const void *urlrouter_find_noparams(const urlrouter *router, const char *path);
+
+	/**
+	 * @brief Check if a path matches a route with non-null data.
+	 */
+	URLROUTER_API int urlrouter_exists(const urlrouter *router, const char *path);
+
+	/**
+	 * @brief Same as urlrouter_find for a params array that can hold the params of any
+	 * route, so that the lookup does not check its length.
+	 * @param params An array of at least `router->max_params` entries
+	 * @param param_cnt A pointer that will be set to the number of params
+	 */
+	URLROUTER_API const void *urlrouter_find_fixed(const urlrouter *router, const char *path,
+												   urlparam *params, unsigned int *param_cnt);
+
+	/**
+	 * @brief Find a host and a path in the router.
+	 * The routes added with urlrouter_add_host are matched first, in one traversal of
+	 * the host followed by the path. If none matches, the routes added without host
+	 * are searched with urlrouter_find.
+	 * @param host The host of the request, without port
+	 * @param path The path of the request
+	 * The other params and the return value are the same as urlrouter_find. The host
+	 * params come first in `params` and are slices of `host`.
+	 * A host containing a '/' or a path not starting with '/' only matches the routes added
+	 * without host.
+	 */
+	URLROUTER_API const void *urlrouter_find_host(const urlrouter *router, const char *host,
+												  const char *path, urlparam *params,
+												  const unsigned int len, unsigned int *param_cnt);
+
+	/**
+	 * @brief Generate the url of a route, like snprintf would.
+	 * The route template is compiled when the route is added so there is no parsing.
+	 * Escaped braces are written once and each param is replaced by the given value.
+	 * @param router The router containing the route
+	 * @param route The route id
+	 * @param params The value of each param of the route, in order
+	 * @param n The number of params
+	 * @param out The output buffer. The url is written only if it fits with its
+	 * null terminator.
+	 * @param out_len The size of the output buffer
+	 * @returns The length of the url, URLROUTER_ERR_NOT_FOUND if there is no such route or
+	 * URLROUTER_ERR_MISSING_PARAM if `n` is lower than the number of params of the route.
+	 */
+	URLROUTER_API int urlrouter_url_for(const urlrouter *router, unsigned int route,
+										const urlparam *params, unsigned int n, char *out,
+										unsigned long out_len);
+
+	/**
+	 * @brief Same as urlrouter_find_host but it also fills `match` so that the params can
+	 * be accessed by name with urlrouter_param_get.
+	 * For a route of a mounted router, `match->router` and `match->route` are the mounted
+	 * router and the id of the route in it, `match->id` is the id of the route in `router`
+	 * and `match->params` starts after the params of the prefix.
+	 * @param host The host of the request, can be null to only search the routes added
+	 * without host
+	 * @returns The data associated with the route or NULL if not found
+	 */
+	URLROUTER_API const void *urlrouter_find_match(const urlrouter *router, const char *host,
+												   const char *path, urlparam *params,
+												   const unsigned int len, urlrouter_match *match);
+
+	/**
+	 * @brief Hash a param name into the key used by the param name table of the routes.
+	 * For a string literal it is usually computed at compile time.
+	 */
+	static inline unsigned int urlrouter_param_key(const char *name)
+	{
+		unsigned int key = 2166136261u;
+		while (*name)
+			key = (key ^ (unsigned char)*name++) * 16777619u;
+		return key;
+	}
+
+	/**
+	 * @brief Get a param of a match by the key of its name, see urlrouter_param_key.
+	 * The name table of the matched route is built when the route is added, so there is no
+	 * name comparison. The names of a route have different keys, routes where two of them
+	 * collide are rejected with URLROUTER_ERR_PARAM_COLLISION, but a name the route does not
+	 * have can still collide with one it has: use urlrouter_param_get for untrusted names.
+	 * @returns The param or NULL if the route has no such param or if it did not fit in the
+	 * params array given to urlrouter_find_match
+	 */
+	URLROUTER_API const urlparam *urlrouter_param_get_key(const urlrouter_match *match,
+														  unsigned int key);
+
+	/**
+	 * @brief Get a param of a match by its name, like `urlrouter_param_get(&match, "id")`.
+	 * Same as urlrouter_param_get_key, but the name is compared once its key is found.
+	 */
+	URLROUTER_API const urlparam *urlrouter_param_get(const urlrouter_match *match,
+													  const char *name);
+
+#ifndef URLROUTER_MATCHER_THREADS
+// Number of candidate routes a urlrouter_matcher can follow at once
+#define URLROUTER_MATCHER_THREADS 4
+#endif
+#ifndef URLROUTER_MATCHER_PARAMS
+// Number of params a urlrouter_matcher keeps for each candidate
+#define URLROUTER_MATCHER_PARAMS 8
+#endif
+
+	/**
+	 * A param found by a urlrouter_matcher, as a range of the chunks given to
+	 * urlrouter_match_feed. Chunks are numbered by feed call, starting from 0.
+	 * The param is not copied so it can span several chunks.
+	 */
+	typedef struct
+	{
+		// The chunk of the first byte of the param and its offset in that chunk
+		unsigned int first_chunk;
+		unsigned int first;
+		// The chunk of the last byte of the param and the offset after it in that chunk
+		unsigned int last_chunk;
+		unsigned int end;
+		// Total length of the param
+		unsigned int len;
+	} urlrouter_chunk_param;
+
+	/**
+	 * A node of the tree matched by a urlrouter_matcher up to the last fed byte.
+	 */
+	typedef struct
+	{
+		const urlrouter_node *node;
+		// Offset in the fragment of the node
+		unsigned char off;
+		// Whether the last byte was part of a param
+		unsigned char in_param;
+		unsigned short param_cnt;
+		urlrouter_chunk_param params[URLROUTER_MATCHER_PARAMS];
+	} urlrouter_matcher_thread;
+
+	/**
+	 * The state of a lookup of a path given in chunks, see urlrouter_match_begin.
+	 * A static node and a param node can both match the bytes received so far, so the
+	 * matcher follows all the nodes that find would still try, in the order it would try
+	 * them.
+	 */
+	typedef struct
+	{
+		const urlrouter *router;
+		urlrouter_matcher_thread threads[URLROUTER_MATCHER_THREADS];
+		unsigned int thread_cnt;
+		// Index of the next chunk
+		unsigned int chunk;
+		// Whether a byte was fed
+		unsigned char started;
+		int err;
+	} urlrouter_matcher;
+
+	/**
+	 * @brief Start the lookup of a path that is received in chunks, like a request target
+	 * split across reads or frames. The chunks are matched as they arrive, without
+	 * being copied, and the lookup gives the same result as urlrouter_find on the
+	 * whole path. Only the routes added without host are searched.
+	 * @param matcher The matcher state, it can live on the stack
+	 * @param router The router to search in
+	 */
+	URLROUTER_API void urlrouter_match_begin(urlrouter_matcher *matcher, const urlrouter *router);
+
+	/**
+	 * @brief Match the next chunk of the path.
+	 * @param chunk The bytes of the chunk, without null terminator. It must outlive the
+	 * matcher if the params are read.
+	 * @param len The number of bytes of the chunk
+	 * @returns 1 if a route can still match, 0 if no route can match whatever the next
+	 * chunks are, or URLROUTER_ERR_BUFF_FULL if more than URLROUTER_MATCHER_THREADS nodes
+	 * had to be followed at once. The lookup then fails and the path should be looked up
+	 * with urlrouter_find.
+	 */
+	URLROUTER_API int urlrouter_match_feed(urlrouter_matcher *matcher, const char *chunk,
+										   unsigned long len);
+
+	/**
+	 * @brief Finish the lookup once the whole path was fed.
+	 * @param params An array that will be populated with the params of the route, can be
+	 * null. At most URLROUTER_MATCHER_PARAMS params are kept.
+	 * @param len The length of the array
+	 * @param param_cnt A pointer that will be set to the number of params, can be null
+	 * @returns The data associated with the path or NULL if the path is not found
+	 */
+	URLROUTER_API const void *urlrouter_match_end(urlrouter_matcher *matcher,
+												  urlrouter_chunk_param *params,
+												  const unsigned int len, unsigned int *param_cnt);
+
+#ifndef URLROUTER_CACHE_ENTRIES
+// Number of entries of a urlrouter_cache, a power of two
+#define URLROUTER_CACHE_ENTRIES 64
+#endif
+#ifndef URLROUTER_CACHE_PATH
+// Longest path stored in a urlrouter_cache, at most 255
+#define URLROUTER_CACHE_PATH 64
+#endif
+#ifndef URLROUTER_CACHE_PARAMS
+// Highest number of params of a route stored in a urlrouter_cache
+#define URLROUTER_CACHE_PARAMS 4
+#endif
+
+	/**
+	 * A path looked up with urlrouter_find_cached and its result. The params are stored as
+	 * offsets in the path so that they can be given for another copy of the same path.
+	 */
+	typedef struct
+	{
+		const void *data;
+		// The router and its generation the result was found in, NULL for an empty entry
+		const urlrouter *router;
+		unsigned int generation;
+		// Length of the path
+		unsigned char len;
+		unsigned char param_cnt;
+		unsigned char param_off[URLROUTER_CACHE_PARAMS];
+		unsigned char param_len[URLROUTER_CACHE_PARAMS];
+		char path[URLROUTER_CACHE_PATH];
+	} urlrouter_cache_entry;
+
+	/**
+	 * A direct-mapped cache of the results of urlrouter_find, indexed by the hash of the
+	 * path. It doesn't allocate and it is not synchronized: each thread should have its
+	 * own, like a `static _Thread_local urlrouter_cache` or one per worker. It can be used
+	 * with several routers, the entries found in one are not given for another.
+	 * The entries are invalidated when routes are added to the router.
+	 */
+	typedef struct
+	{
+		urlrouter_cache_entry entries[URLROUTER_CACHE_ENTRIES];
+		// Number of lookups answered by the cache and number of lookups that walked the tree
+		unsigned long hits;
+		unsigned long misses;
+	} urlrouter_cache;
+
+	/**
+	 * @brief Empty a cache and reset its counters. It must also be done when the router it
+	 * is used with is initialized again.
+	 */
+	URLROUTER_API void urlrouter_cache_init(urlrouter_cache *cache);
+
+	/**
+	 * @brief Same as urlrouter_find, but the result is looked up in `cache` first.
+	 * Only the paths of at most URLROUTER_CACHE_PATH bytes that match a route with at most
+	 * URLROUTER_CACHE_PARAMS params are stored. An entry is replaced by the last path
+	 * found with the same hash.
+	 */
+	URLROUTER_API const void *urlrouter_find_cached(const urlrouter *router, urlrouter_cache *cache,
+													const char *path, urlparam *params,
+													const unsigned int len,
+													unsigned int *param_cnt);
+
+	enum
+	{
+		// Lookups walk the tree, the default
+		URLROUTER_ENGINE_TREE = 0,
+
+		// Lookups run a DFA compiled from the tree
+		URLROUTER_ENGINE_DFA = 1
+	};
+
+	/**
+	 * @brief Select how the routes added without host are looked up by urlrouter_find and
+	 * the other lookups.
+	 * With URLROUTER_ENGINE_DFA, the tree is compiled into a DFA stored in the buffer. Each
+	 * byte of the path is then one byte class load and one transition load, without
+	 * branches on the tree. The params are read back from the template of the matched
+	 * route. The results are the same as with the tree.
+	 * The number of states grows with the total length of the routes, so it suits tables
+	 * of up to a few thousand routes.
+	 * Adding routes switches back to the tree without freeing the DFA, the engine should be
+	 * set once all the routes are added. Setting URLROUTER_ENGINE_TREE frees it if nothing
+	 * was allocated after it.
+	 * @returns The remaining space in the buffer or URLROUTER_ERR_BUFF_FULL if the DFA does
+	 * not fit in the buffer and URLROUTER_ERR_MOUNTED if the router has mounts, in which case
+	 * the tree is used.
+	 */
+	URLROUTER_API int urlrouter_set_engine(urlrouter *router, int engine);
 
 #ifdef URLROUTER_IO
 	/**
 	 * @brief Print the router tree to the standard output with printf
 	 */
-	void urlrouter_print(const urlrouter *router);
+	URLROUTER_API void urlrouter_print(const urlrouter *router);
 #endif
 
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef URLROUTER_IMPLEMENTATION
+
+#ifdef URLROUTER_IO
+#include <stdio.h>
+#endif
+
+#ifdef URLROUTER_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef URLROUTER_ASSERT
+#include <assert.h>
+#define ur_assert(expr) assert(expr)
+#else
+#define ur_assert(expr) ((void)0)
+#endif
+
+typedef char ur_bool;
+
+static inline ur_bool ur_is_param_start(const char *str)
+{
+	return *str == '{' && *(str + 1) != '{';
+}
+static inline ur_bool ur_is_param_end(const char *str) { return *str == '}' && *(str + 1) != '}'; }
+
+// Only alphanumeric characters are allowed in path parameters
+static inline ur_bool ur_is_valid_param(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '{' ||
+		   c == '}';
+}
+static inline ur_bool ur_is_param_escape_start(const char *str)
+{
+	return *str == '{' && *(str + 1) == '{';
+}
+static inline ur_bool ur_is_param_escape_end(const char *str)
+{
+	return *str == '}' && *(str + 1) == '}';
+}
+
+static inline unsigned long ur_rem_space(urlrouter *router)
+{
+	return router->len - router->cursor - router->route_cnt * sizeof(urlrouter_route);
+}
+
+// Routes are stored backward from the end of the buffer
+static inline urlrouter_route *ur_get_route(const urlrouter *router, unsigned int i)
+{
+	return (urlrouter_route *)((char *)router->buffer + router->len) - i - 1;
+}
+
+// Index of the route with the id `id`, or route_cnt if there is none. The ids only skip the
+// ones reserved by the mounts, so without mounts before it a route is at its id.
+static inline unsigned int ur_route_index(const urlrouter *router, unsigned int id)
+{
+	if (id < router->route_cnt && ur_get_route(router, id)->id == id)
+		return id;
+	unsigned int lo = 0, hi = id < router->route_cnt ? id : router->route_cnt;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (ur_get_route(router, mid)->id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < router->route_cnt && ur_get_route(router, lo)->id == id)
+		return lo;
+	return router->route_cnt;
+}
+
+static inline unsigned int ur_str_len(const char *s)
+{
+	const char *p = s;
+	while (*++p != '\0')
+		;
+	return p - s;
+}
+
+// Allocate `size` bytes from the start of the router buffer, rounded up to keep the
+// nodes aligned. If there is not enough space, returns NULL.
+static inline void *ur_alloc(urlrouter *router, unsigned long size)
+{
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if (ur_rem_space(router) < size)
+		return NULL;
+
+	char *p = (char *)router->buffer + router->cursor;
+	router->cursor += size;
+	return p;
+}
+
+// The header at the start of a chunk given by the allocator, it describes the buffer used
+// before the chunk
+typedef struct
+{
+	void *buffer;
+	unsigned long len;
+	// Bytes used at the start of the buffer
+	unsigned long used;
+} ur_chunk;
+
+// A buffer of the router and the bytes of it in use, from the current one to the one given to
+// urlrouter_init
+typedef struct
+{
+	char *buffer;
+	unsigned long len;
+	unsigned long start;
+	unsigned long used;
+	// Number of chunks before this one, 0 for the buffer given to urlrouter_init
+	unsigned int chunk;
+} ur_region;
+
+static inline ur_region ur_first_region(const urlrouter *router)
+{
+	unsigned long start = router->chunk_cnt ? sizeof(ur_chunk) : 0;
+	return (ur_region){(char *)router->buffer, router->len, start, router->cursor,
+					   router->chunk_cnt};
+}
+
+// Move to the buffer used before `r`, returns 0 if there is none
+static inline ur_bool ur_next_region(ur_region *r)
+{
+	if (r->chunk == 0)
+		return 0;
+	const ur_chunk *head = (const ur_chunk *)r->buffer;
+	r->buffer = (char *)head->buffer;
+	r->len = head->len;
+	r->used = head->used;
+	r->chunk--;
+	r->start = r->chunk ? sizeof(ur_chunk) : 0;
+	return 1;
+}
+
+// After an operation failed with URLROUTER_ERR_BUFF_FULL, get a new chunk from the allocator
+// with `size` free bytes, doubled at each call, and move the route records at its end.
+// Returns 1 if the operation can be retried.
+static inline ur_bool ur_grow(urlrouter *router, unsigned long *size)
+{
+	const urlrouter_allocator *a = &router->allocator;
+	if (a->alloc == NULL)
+		return 0;
+	*size = *size ? *size * 2 : a->chunk_size;
+	unsigned long routes = router->route_cnt * sizeof(urlrouter_route);
+	unsigned long len = sizeof(ur_chunk) + *size + routes;
+	len = (len + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	char *chunk = (char *)a->alloc(a->user, len);
+	if (chunk == NULL)
+		return 0;
+
+	const char *from = (const char *)router->buffer + router->len - routes;
+	for (unsigned long i = 0; i < routes; i++)
+		chunk[len - routes + i] = from[i];
+	ur_chunk *head = (ur_chunk *)chunk;
+	*head = (ur_chunk){router->buffer, router->len, router->cursor};
+
+	// A chunk left empty by the previous retry is replaced
+	if (router->chunk_cnt > 0 && router->cursor == sizeof(ur_chunk))
+	{
+		*head = *(const ur_chunk *)router->buffer;
+		if (a->free)
+			a->free(a->user, router->buffer, router->len);
+		router->chunk_cnt--;
+	}
+	router->buffer = chunk;
+	router->len = len;
+	router->cursor = sizeof(ur_chunk);
+	router->chunk_cnt++;
+	// The operations growing the buffer drop the DFA, which is only freed from the buffer
+	router->dfa = NULL;
+	return 1;
+}
+
+// Create a new node and insert it in the router buffer.
+// If there is not enough space, returns NULL.
+static inline urlrouter_node *ur_create_node(urlrouter *router, const char *frag,
+											 unsigned int frag_len, const void *data,
+											 unsigned int id)
+{
+	char *p = (char *)ur_alloc(router, sizeof(urlrouter_node));
+	if (p == NULL)
+		return NULL;
+
+	for (unsigned long i = 0; i < sizeof(urlrouter_node); i++)
+		((char *)p)[i] = 0;
+	urlrouter_node *node = (urlrouter_node *)p;
+
+	node->frag = frag;
+	node->frag_len = frag_len;
+	node->id = id;
+	node->data = data;
+	return node;
+}
+
+// Check if the path is malformed:
+// - Path parameters should be closed
+// - Path parameters should only contain alphanumeric characters
+// Before `host_end` (if set) `p` is part of a host, where a parameter can also be
+// followed by a '.'.
+static inline int ur_verify_param_keys(const char *p);
+
+static inline int ur_verify_path(const char *p, const char *host_end)
+{
+	const char *start = p;
+	if (*p == '\0' || (*p == '}' && *(p + 1) == '\0'))
+		return URLROUTER_ERR_MALFORMED_PATH;
+
+	ur_bool is_param = ur_is_param_start(p);
+	int param_len = 0;
+	while (*p)
+	{
+		// Check for escaped characters ('{{' and '}}')
+		if (ur_is_param_escape_start(p) || ur_is_param_escape_end(p))
+		{
+			p += 2; // Skip escaped braces
+			continue;
+		}
+
+		if (is_param)
+		{
+			param_len++;
+			if (ur_is_param_end(p))
+			{
+				char next = *(p + 1);
+				// When closing a path parameter, the next character
+				// should be the end of a fragment
+				ur_bool in_host = host_end && p + 1 < host_end;
+				if ((next != '/' && next != '\0' && !(in_host && next == '.')) || param_len < 2)
+					return URLROUTER_ERR_MALFORMED_PATH;
+				else
+					is_param = param_len = 0;
+			}
+			else if (!ur_is_valid_param(*p))
+				return URLROUTER_ERR_MALFORMED_PATH;
+		}
+		else
+		{
+			if (ur_is_param_end(p)) // Closing a path parameter that was not opened
+				return URLROUTER_ERR_MALFORMED_PATH;
+			else
+				is_param = ur_is_param_start(p);
+		}
+
+		p++;
+	}
+
+	if (is_param) // Path parameter is not closed
+		return URLROUTER_ERR_MALFORMED_PATH;
+
+	return ur_verify_param_keys(start);
+}
+
+// Symbols used to order routes for urlrouter_build. A whole {param} is one symbol
+// that sorts after every literal byte so that static nodes keep priority over
+// params, exactly like urlrouter_add does.
+#define UR_SYM_END -1
+#define UR_SYM_PARAM 256
+
+// Read the symbol at `p`. `{{` and `}}` are read as their literal brace.
+// `width` is set to the number of bytes of `p` covered by the symbol.
+// `p` MUST be a suffix of a path accepted by ur_verify_path.
+static inline int ur_path_sym(const char *p, unsigned int *width)
+{
+	const char *s = p;
+	if (*p == '\0')
+	{
+		*width = 0;
+		return UR_SYM_END;
+	}
+	if (ur_is_param_escape_start(p) || ur_is_param_escape_end(p))
+	{
+		*width = 2;
+		return (unsigned char)*p;
+	}
+	if (!ur_is_param_start(p))
+	{
+		*width = 1;
+		return (unsigned char)*p;
+	}
+	// Consume the param the same way ur_verify_path does: escaped braces are part of the name
+	p++;
+	while (!ur_is_param_end(p))
+		p += ur_is_param_escape_start(p) || ur_is_param_escape_end(p) ? 2 : 1;
+	*width = p + 1 - s;
+	return UR_SYM_PARAM;
+}
+
+// Longest fragment of a node
+#define UR_FRAG_MAX 127
+
+// Read the part of the route at `p` held by one node: a param, or at most `max` literal
+// symbols up to the next param. An escaped brace ends the literal, its first brace being the
+// unescaped one, so that a static fragment is always a slice of the route. `frag`, `frag_len`
+// and `kind` are set for the node and the number of bytes of `p` read is returned.
+static inline unsigned int ur_token(const char *p, unsigned int max, const char **frag,
+									unsigned int *frag_len, unsigned int *kind)
+{
+	unsigned int w, n = 0;
+	if (ur_path_sym(p, &w) == UR_SYM_PARAM)
+	{
+		*frag = p + 1;
+		*frag_len = w - 2 < UR_FRAG_MAX ? w - 2 : UR_FRAG_MAX;
+		*kind = URLROUTER_NODE_PARAM;
+		return w;
+	}
+
+	const char *s = p;
+	int sym;
+	if (max > UR_FRAG_MAX)
+		max = UR_FRAG_MAX;
+	while (n < max && (sym = ur_path_sym(s, &w)) != UR_SYM_END && sym != UR_SYM_PARAM)
+	{
+		s += w;
+		n++;
+		if (w == 2)
+			break;
+	}
+	*frag = p;
+	*frag_len = n;
+	*kind = URLROUTER_NODE_STATIC;
+	return s - p;
+}
+
+URLROUTER_API void urlrouter_init(urlrouter *router, void *buffer, unsigned long len)
+{
+	router->root = NULL;
+	router->host_root = NULL;
+	router->buffer = buffer;
+	// Keep the routes stored at the end of the buffer aligned
+	router->len = len & ~(sizeof(void *) - 1);
+	router->cursor = 0;
+	router->route_cnt = 0;
+	router->max_params = 0;
+	router->generation = 0;
+	router->dfa = NULL;
+	router->mounts = NULL;
+	router->id_cnt = 0;
+	router->allocator = (urlrouter_allocator){NULL, NULL, NULL, 0};
+	router->chunk_cnt = 0;
+
+	// No path matches an empty router
+	for (unsigned int i = 0; i < URLROUTER_FILTER_BITS / 32; i++)
+	{
+		router->filter.prefixes[i] = 0;
+		router->filter.param_prefixes[i] = 0;
+	}
+	router->filter.param_led = 0;
+	router->filter.param_leaf = 0;
+	router->filter.any_prefix = 0;
+	router->filter.min_len = ~0u;
+	router->filter.max_len = 0;
+}
+
+URLROUTER_API void urlrouter_set_allocator(urlrouter *router,
+										   const urlrouter_allocator *allocator)
+{
+	ur_assert(allocator->alloc == NULL || allocator->chunk_size > 0);
+	router->allocator = *allocator;
+}
+
+URLROUTER_API void urlrouter_free(urlrouter *router)
+{
+	ur_region r = ur_first_region(router);
+	const urlrouter_allocator a = router->allocator;
+	while (r.chunk > 0)
+	{
+		char *chunk = r.buffer;
+		unsigned long len = r.len;
+		ur_next_region(&r);
+		if (a.free)
+			a.free(a.user, chunk, len);
+	}
+	unsigned int generation = router->generation;
+	urlrouter_init(router, r.buffer, r.len);
+	router->allocator = a;
+	router->generation = generation + 1;
+}
+
+// Split `p` into template pieces and return their number, `param_cnt` is set to the
+// number of params. If `pieces` is NULL, they are only counted.
+static inline unsigned int ur_compile_template(const char *p, urlrouter_piece *pieces,
+											   unsigned int *param_cnt)
+{
+	unsigned int cnt = 0, width;
+	const char *literal = p;
+	*param_cnt = 0;
+	for (;;)
+	{
+		ur_bool escape = ur_is_param_escape_start(p) || ur_is_param_escape_end(p);
+		if (*p != '\0' && !escape && !ur_is_param_start(p))
+		{
+			p++;
+			continue;
+		}
+
+		// Flush the pending literal, an escape is unescaped by keeping its first brace
+		const char *end = escape ? p + 1 : p;
+		if (end > literal && pieces)
+			pieces[cnt] = (urlrouter_piece){literal, end - literal, 0};
+		cnt += end > literal;
+		if (*p == '\0')
+			return cnt;
+
+		if (escape)
+			width = 2;
+		else
+		{
+			ur_path_sym(p, &width);
+			if (pieces)
+				pieces[cnt] = (urlrouter_piece){p + 1, width - 2, 1};
+			cnt++;
+			++*param_cnt;
+		}
+		p += width;
+		literal = p;
+	}
+}
+
+// Must give the same keys as urlrouter_param_key
+static inline unsigned int ur_param_key(const char *name, unsigned int len)
+{
+	unsigned int key = 2166136261u;
+	for (unsigned int i = 0; i < len; i++)
+		key = (key ^ (unsigned char)name[i]) * 16777619u;
+	return key;
+}
+
+// Find the next param of a path accepted by ur_verify_path, set its name and return the end of
+// the param, or NULL if there is none
+static inline const char *ur_next_param(const char *p, const char **name, unsigned int *len)
+{
+	unsigned int width;
+	for (; *p; p += width)
+	{
+		if (ur_path_sym(p, &width) == UR_SYM_PARAM)
+		{
+			*name = p + 1;
+			*len = width - 2;
+			return p + width;
+		}
+	}
+	return NULL;
+}
+
+// The param name table only stores the keys, so two different names of a route must not
+// have the same key. A name used twice is fine, it keeps its first position.
+static inline int ur_verify_param_keys(const char *p)
+{
+	const char *a, *b;
+	unsigned int a_len, b_len;
+	while ((p = ur_next_param(p, &a, &a_len)) != NULL)
+	{
+		unsigned int key = ur_param_key(a, a_len);
+		for (const char *q = p; (q = ur_next_param(q, &b, &b_len)) != NULL;)
+		{
+			if (ur_param_key(b, b_len) != key)
+				continue;
+			unsigned int i = 0;
+			while (i < a_len && a_len == b_len && a[i] == b[i])
+				i++;
+			if (i != a_len || a_len != b_len)
+				return URLROUTER_ERR_PARAM_COLLISION;
+		}
+	}
+	return 0;
+}
+
+// Size of the param name table of a route, a power of two at least twice the number of
+// params so that probe sequences stay short
+static inline unsigned int ur_slot_cnt(unsigned int param_cnt)
+{
+	unsigned int cnt = 1;
+	while (cnt < 2 * param_cnt)
+		cnt *= 2;
+	return param_cnt ? cnt : 0;
+}
+
+// Number of bytes needed to compile `path`: its pieces then its param name table
+static inline unsigned long ur_template_size(const char *path)
+{
+	unsigned int param_cnt, piece_cnt = ur_compile_template(path, NULL, &param_cnt);
+	return piece_cnt * sizeof(urlrouter_piece) +
+		   ur_slot_cnt(param_cnt) * sizeof(urlrouter_param_slot);
+}
+
+// Compile `path` into `mem`, of ur_template_size(path) bytes, and describe it in `route`
+static inline void ur_fill_route(urlrouter_route *route, const char *path, void *mem)
+{
+	unsigned int param_cnt;
+	urlrouter_piece *pieces = (urlrouter_piece *)mem;
+	route->pieces = pieces;
+	route->piece_cnt = ur_compile_template(path, pieces, &param_cnt);
+	route->param_cnt = param_cnt;
+	route->slot_mask = ur_slot_cnt(param_cnt) - 1;
+	route->len = 0;
+
+	urlrouter_param_slot *slots = (urlrouter_param_slot *)(pieces + route->piece_cnt);
+	for (unsigned int i = 0; i < ur_slot_cnt(param_cnt); i++)
+		slots[i].index = 0;
+	for (unsigned int i = 0, param_i = 0; i < route->piece_cnt; i++)
+	{
+		if (!pieces[i].is_param)
+		{
+			route->len += pieces[i].len;
+			continue;
+		}
+
+		// Linear probing, a name used twice keeps its first position
+		unsigned int key = ur_param_key(pieces[i].str, pieces[i].len);
+		unsigned int slot = key & route->slot_mask;
+		while (slots[slot].index != 0 && slots[slot].key != key)
+			slot = (slot + 1) & route->slot_mask;
+		if (slots[slot].index == 0)
+			slots[slot] = (urlrouter_param_slot){key, param_i + 1, i};
+		param_i++;
+	}
+}
+
+// Hash of the first URLROUTER_FILTER_PREFIX bytes of a path
+static inline unsigned int ur_prefix_hash(const unsigned char *p)
+{
+	unsigned int h = (p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24) * 2654435761u;
+	return h ^ h >> 15;
+}
+
+// The two bits of a bloom filter of urlrouter_filter set by a prefix
+static inline ur_bool ur_filter_test(const unsigned int *bits, unsigned int hash)
+{
+	unsigned int a = hash & (URLROUTER_FILTER_BITS - 1);
+	unsigned int b = (hash >> 16) & (URLROUTER_FILTER_BITS - 1);
+	return (bits[a / 32] >> (a % 32) & 1) && (bits[b / 32] >> (b % 32) & 1);
+}
+
+static inline void ur_filter_set(unsigned int *bits, const unsigned char *prefix)
+{
+	unsigned int hash = ur_prefix_hash(prefix);
+	unsigned int a = hash & (URLROUTER_FILTER_BITS - 1);
+	unsigned int b = (hash >> 16) & (URLROUTER_FILTER_BITS - 1);
+	bits[a / 32] |= 1u << (a % 32);
+	bits[b / 32] |= 1u << (b % 32);
+}
+
+// A param can't hold a '/', so the path of a route whose first '/' after its first byte
+// follows its param has its bytes after the param there: the bytes before are not checked
+static inline ur_bool ur_filter_lead_ok(const unsigned char *lead, unsigned int len)
+{
+	for (unsigned int i = 1; i < len; i++)
+	{
+		if (lead[i] == '/')
+			return 0;
+	}
+	return 1;
+}
+
+// Add a route added without host to the filter of the router
+static inline void ur_filter_add(urlrouter_filter *f, const urlrouter_route *route)
+{
+	// A param matches at least one byte
+	unsigned int min_len = route->len + route->param_cnt;
+	unsigned int max_len = route->param_cnt ? ~0u : route->len;
+	if (min_len < f->min_len)
+		f->min_len = min_len;
+	if (max_len > f->max_len)
+		f->max_len = max_len;
+
+	// The prefix is read from the literal pieces, escapes are already unescaped
+	unsigned char prefix[URLROUTER_FILTER_PREFIX];
+	unsigned int len = 0, i = 0;
+	for (; i < route->piece_cnt && !route->pieces[i].is_param; i++)
+	{
+		const urlrouter_piece *piece = &route->pieces[i];
+		for (unsigned int j = 0; j < piece->len && len < URLROUTER_FILTER_PREFIX; j++)
+			prefix[len++] = piece->str[j];
+	}
+	if (len == URLROUTER_FILTER_PREFIX)
+	{
+		ur_filter_set(f->prefixes, prefix);
+		return;
+	}
+	// A shorter route only matches paths shorter than the prefix, they are not filtered
+	if (i == route->piece_cnt)
+		return;
+
+	// A param ends at a '/', the next piece starts with it
+	if (!ur_filter_lead_ok(prefix, len))
+	{
+		f->any_prefix = 1;
+		return;
+	}
+	f->param_led = 1;
+	if (++i == route->piece_cnt)
+	{
+		f->param_leaf = 1;
+		return;
+	}
+	unsigned char rest[URLROUTER_FILTER_PREFIX];
+	len = 0;
+	for (; i < route->piece_cnt && !route->pieces[i].is_param; i++)
+	{
+		const urlrouter_piece *piece = &route->pieces[i];
+		for (unsigned int j = 0; j < piece->len && len < URLROUTER_FILTER_PREFIX; j++)
+			rest[len++] = piece->str[j];
+	}
+	if (len < URLROUTER_FILTER_PREFIX)
+		f->any_prefix = 1;
+	else
+		ur_filter_set(f->param_prefixes, rest);
+}
+
+// Check the bytes of `path` after its first '/' after its first byte against the routes with
+// a param in their prefix
+static inline ur_bool ur_filter_param_test(const urlrouter_filter *f, const unsigned char *p)
+{
+	if (!f->param_led)
+		return 0;
+	const unsigned char *r = p + 1;
+	while (*r != '/' && *r != '\0')
+		r++;
+	if (*r == '\0')
+		return f->param_leaf;
+	return r[1] && r[2] && r[3] && ur_filter_test(f->param_prefixes, ur_prefix_hash(r));
+}
+
+// Check if `path` can't match any route of the filter. It is never true for a path that
+// matches a route.
+static inline ur_bool ur_filter_rejects(const urlrouter_filter *f, const char *path)
+{
+	const unsigned char *p = (const unsigned char *)path;
+	unsigned int i = 0;
+	if (p[0] && p[1] && p[2] && p[3])
+	{
+		if (!f->any_prefix && !ur_filter_test(f->prefixes, ur_prefix_hash(p)) &&
+			!ur_filter_param_test(f, p))
+			return 1;
+		i = URLROUTER_FILTER_PREFIX;
+	}
+
+	for (; i < f->min_len; i++)
+	{
+		if (p[i] == '\0')
+			return 1;
+	}
+	if (f->max_len != ~0u)
+	{
+		for (; p[i] != '\0'; i++)
+		{
+			if (i >= f->max_len)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+// A router mounted with urlrouter_mount
+struct urlrouter_mount
+{
+	// The node where the prefix ends
+	const urlrouter_node *node;
+	const urlrouter *sub;
+	// Id of the first route of `sub` in the router, the next id when it was mounted
+	unsigned int id_base;
+	struct urlrouter_mount *next;
+};
+
+static inline int ur_insert_path(urlrouter *router, urlrouter_node **root, const char *path,
+								 const void *data, unsigned int id, urlrouter_node **mount);
+
+// Add `path` to the tree at `root`. On error, the buffer is rolled back to `cursor`.
+static inline int ur_add_route(urlrouter *router, urlrouter_node **root, const char *path,
+							   const char *host_end, const void *data, unsigned long cursor)
+{
+	// Validate the full path upfront so that partial-path checks later
+	// (which only see the remaining suffix) cannot miss invalid patterns
+	// such as a static suffix immediately after a closed parameter.
+	int err = ur_verify_path(path, host_end);
+	if (err != 0)
+	{
+		router->cursor = cursor;
+		return err;
+	}
+
+	// The route is compiled first, it is simply dropped if the path can't be inserted
+	void *mem = ur_alloc(router, ur_template_size(path));
+	if (mem == NULL || ur_rem_space(router) < sizeof(urlrouter_route))
+	{
+		router->cursor = cursor;
+		return URLROUTER_ERR_BUFF_FULL;
+	}
+	ur_fill_route(ur_get_route(router, router->route_cnt++), path, mem);
+
+	urlrouter_route *route = ur_get_route(router, router->route_cnt - 1);
+	route->id = router->id_cnt;
+	err = ur_insert_path(router, root, path, data, router->route_cnt - 1, NULL);
+	if (err < 0)
+	{
+		router->cursor = cursor;
+		router->route_cnt--;
+	}
+	else
+	{
+		// The cached lookups and the DFA are not valid anymore
+		router->generation++;
+		router->dfa = NULL;
+		router->id_cnt++;
+		if (route->param_cnt > router->max_params)
+			router->max_params = route->param_cnt;
+		if (root == &router->root)
+			ur_filter_add(&router->filter, route);
+	}
+	return err;
+}
+
+URLROUTER_API int urlrouter_add(urlrouter *router, const char *path, const void *data)
+{
+	ur_assert(path != NULL);
+	int err;
+	unsigned long size = 0;
+	while ((err = ur_add_route(router, &router->root, path, NULL, data, router->cursor)) ==
+			   URLROUTER_ERR_BUFF_FULL &&
+		   ur_grow(router, &size))
+		;
+	return err;
+}
+
+static inline int ur_add_host(urlrouter *router, const char *host, const char *path,
+							  const void *data)
+{
+	unsigned int host_len = 0;
+	while (host[host_len] != '\0')
+	{
+		if (host[host_len++] == '/')
+			return URLROUTER_ERR_MALFORMED_PATH;
+	}
+	if (host_len == 0 || *path != '/')
+		return URLROUTER_ERR_MALFORMED_PATH;
+
+	// The host and the path are stored as one key, the path starts at the first '/'
+	unsigned long cursor = router->cursor;
+	unsigned int path_len = ur_str_len(path);
+	char *key = (char *)ur_alloc(router, host_len + path_len + 1);
+	if (key == NULL)
+		return URLROUTER_ERR_BUFF_FULL;
+	for (unsigned int i = 0; i < host_len; i++)
+		key[i] = host[i];
+	for (unsigned int i = 0; i <= path_len; i++)
+		key[host_len + i] = path[i];
+
+	return ur_add_route(router, &router->host_root, key, key + host_len, data, cursor);
+}
+
+URLROUTER_API int urlrouter_add_host(urlrouter *router, const char *host, const char *path,
+									 const void *data)
+{
+	ur_assert(host != NULL && path != NULL);
+	int err;
+	unsigned long size = 0;
+	while ((err = ur_add_host(router, host, path, data)) == URLROUTER_ERR_BUFF_FULL &&
+		   ur_grow(router, &size))
+		;
+	return err;
+}
+
+// Create the nodes of the route at `p`, which is not empty, each one the only child of the
+// previous one. The last one gets `data` and `id`. Returns the first one, or NULL if the
+// buffer is full.
+static inline urlrouter_node *ur_create_chain(urlrouter *router, const char *p,
+											  const void *data, unsigned int id)
+{
+	urlrouter_node *head = NULL, *last = NULL;
+	while (*p)
+	{
+		const char *frag;
+		unsigned int frag_len, kind;
+		p += ur_token(p, UR_FRAG_MAX, &frag, &frag_len, &kind);
+		urlrouter_node *node = ur_create_node(router, frag, frag_len, NULL, 0);
+		if (node == NULL)
+			return NULL;
+		node->kind = kind;
+		if (last)
+			last->first_child = node;
+		else
+			head = node;
+		last = node;
+	}
+	last->data = data;
+	last->id = id;
+	return head;
+}
+
+// Insert a path verified by ur_verify_path in the tree at `root`. The new nodes are allocated
+// before the tree is changed, so that it is left as it was if the buffer is full.
+// If `mount` is set, the path is a mount prefix: `data` is not set and `mount` is set to the
+// node where the path ends, which must not have children.
+static inline int ur_insert_path(urlrouter *router, urlrouter_node **root, const char *path,
+								 const void *data, unsigned int id, urlrouter_node **mount)
+{
+	const char *p = path;
+	urlrouter_node **link = root, *node = NULL;
+	while (*p)
+	{
+		const char *frag;
+		unsigned int frag_len, kind, width = ur_token(p, UR_FRAG_MAX, &frag, &frag_len, &kind);
+
+		// The static children come first so that they have priority over the param one, at most
+		// one param child is needed since they all match the same paths
+		urlrouter_node **at = link;
+		while (*at != NULL && (*at)->kind == URLROUTER_NODE_STATIC &&
+			   (kind == URLROUTER_NODE_PARAM || *(*at)->frag != *frag))
+			at = &(*at)->next_sibling;
+		urlrouter_node *child = *at;
+		if (child == NULL || child->kind != kind)
+		{
+			urlrouter_node *new_node = ur_create_chain(router, p, data, id);
+			if (new_node == NULL)
+				return URLROUTER_ERR_BUFF_FULL;
+			new_node->next_sibling = child;
+			*at = new_node;
+			if (mount)
+			{
+				for (*mount = new_node; (*mount)->first_child; *mount = (*mount)->first_child)
+					;
+			}
+			return ur_rem_space(router);
+		}
+
+		unsigned int lcp = 0;
+		while (kind == URLROUTER_NODE_STATIC && lcp < frag_len && lcp < child->frag_len &&
+			   child->frag[lcp] == frag[lcp])
+			lcp++;
+		p += kind == URLROUTER_NODE_PARAM || lcp == frag_len ? width : lcp;
+
+		if (kind == URLROUTER_NODE_STATIC && lcp < child->frag_len)
+		{
+			// The child would end the prefix with the lower part as child
+			if (mount && *p == '\0')
+				return URLROUTER_ERR_PATH_EXISTS;
+
+			// Split the child, the rest of the path is a sibling of its lower part
+			urlrouter_node *new_node = *p != '\0' ? ur_create_chain(router, p, data, id) : NULL;
+			urlrouter_node *lower = ur_create_node(router, child->frag + lcp,
+												   child->frag_len - lcp, child->data, child->id);
+			if ((*p != '\0' && new_node == NULL) || lower == NULL)
+				return URLROUTER_ERR_BUFF_FULL;
+			lower->first_child = child->first_child;
+			lower->next_sibling = new_node;
+			if (child->mount)
+			{
+				// The lower part is now where the prefix ends
+				struct urlrouter_mount *m = router->mounts;
+				while (m->node != child)
+					m = m->next;
+				m->node = lower;
+				lower->mount = 1;
+			}
+			child->frag_len = lcp;
+			child->first_child = lower;
+			child->data = new_node == NULL ? data : NULL;
+			child->id = id;
+			child->mount = 0;
+			if (mount)
+			{
+				for (*mount = new_node; (*mount)->first_child; *mount = (*mount)->first_child)
+					;
+			}
+			return ur_rem_space(router);
+		}
+		// The routes below a mount belong to the mounted router
+		if (child->mount && *p != '\0')
+			return URLROUTER_ERR_PATH_EXISTS;
+		node = child;
+		link = &child->first_child;
+	}
+
+	if (mount)
+	{
+		if (node->first_child != NULL || node->mount)
+			return URLROUTER_ERR_PATH_EXISTS;
+		*mount = node;
+		return ur_rem_space(router);
+	}
+	if (node->data != NULL)
+		return URLROUTER_ERR_PATH_EXISTS;
+	node->data = data;
+	node->id = id;
+	return ur_rem_space(router);
+}
+
+// Add the paths made of `prefix` followed by a path of the filter `sub` to the filter `f`
+static inline void ur_filter_mount(urlrouter_filter *f, const char *prefix,
+								   const urlrouter_filter *sub)
+{
+	// The prefix is read like a route: its literal bytes, its params, its first bytes and the
+	// bytes after its first param
+	unsigned char bytes[URLROUTER_FILTER_PREFIX], rest[URLROUTER_FILTER_PREFIX];
+	unsigned int len = 0, param_cnt = 0, known = 0, rest_len = 0, width;
+	for (int sym; (sym = ur_path_sym(prefix, &width)) != UR_SYM_END; prefix += width)
+	{
+		if (sym == UR_SYM_PARAM)
+			param_cnt++;
+		else
+		{
+			if (param_cnt == 0 && known < URLROUTER_FILTER_PREFIX)
+				bytes[known++] = sym;
+			else if (param_cnt == 1 && rest_len < URLROUTER_FILTER_PREFIX)
+				rest[rest_len++] = sym;
+			len++;
+		}
+	}
+
+	// A param matches at least one byte
+	unsigned int min_len = len + param_cnt + sub->min_len;
+	unsigned int max_len = param_cnt || sub->max_len == ~0u ? ~0u : len + sub->max_len;
+	if (min_len < f->min_len)
+		f->min_len = min_len;
+	if (max_len > f->max_len)
+		f->max_len = max_len;
+
+	if (known == URLROUTER_FILTER_PREFIX)
+		ur_filter_set(f->prefixes, bytes);
+	// Otherwise the first bytes depend on a param or on the routes of `sub`
+	else if (param_cnt == 0 || !ur_filter_lead_ok(bytes, known))
+		f->any_prefix = 1;
+	else
+	{
+		f->param_led = 1;
+		if (rest_len == URLROUTER_FILTER_PREFIX)
+			ur_filter_set(f->param_prefixes, rest);
+		// A prefix ending with its param, like "/v{n}", is followed by the paths of `sub`,
+		// whose first bytes are in its filter unless a route of `sub` can't be summarized
+		// there
+		else if (rest_len == 0)
+		{
+			for (unsigned int i = 0; i < URLROUTER_FILTER_BITS / 32; i++)
+				f->param_prefixes[i] |= sub->prefixes[i];
+			if (sub->any_prefix || sub->param_led || sub->min_len < URLROUTER_FILTER_PREFIX)
+				f->any_prefix = 1;
+		}
+		else
+			f->any_prefix = 1;
+	}
+}
+
+static inline int ur_mount(urlrouter *router, const char *prefix, const urlrouter *sub)
+{
+	int err = ur_verify_path(prefix, NULL);
+	if (err != 0)
+		return err;
+
+	unsigned long cursor = router->cursor;
+	struct urlrouter_mount *m =
+		(struct urlrouter_mount *)ur_alloc(router, sizeof(struct urlrouter_mount));
+	if (m == NULL)
+		return URLROUTER_ERR_BUFF_FULL;
+	urlrouter_node *node;
+	err = ur_insert_path(router, &router->root, prefix, NULL, 0, &node);
+	if (err < 0)
+	{
+		router->cursor = cursor;
+		return err;
+	}
+
+	router->generation++;
+	router->dfa = NULL;
+	node->first_child = sub->root;
+	node->mount = 1;
+	m->node = node;
+	m->sub = sub;
+	m->id_base = router->id_cnt;
+	router->id_cnt += urlrouter_id_cnt(sub);
+	m->next = router->mounts;
+	router->mounts = m;
+
+	unsigned int param_cnt;
+	ur_compile_template(prefix, NULL, &param_cnt);
+	if (param_cnt + sub->max_params > router->max_params)
+		router->max_params = param_cnt + sub->max_params;
+	// An empty router matches nothing
+	if (sub->filter.min_len != ~0u)
+		ur_filter_mount(&router->filter, prefix, &sub->filter);
+	return err;
+}
+
+URLROUTER_API int urlrouter_mount(urlrouter *router, const char *prefix, const urlrouter *sub)
+{
+	ur_assert(prefix != NULL && sub != NULL && sub != router);
+	int err;
+	unsigned long size = 0;
+	while ((err = ur_mount(router, prefix, sub)) == URLROUTER_ERR_BUFF_FULL &&
+		   ur_grow(router, &size))
+		;
+	return err;
+}
+
+// A route being built: the next symbol to consume, its index in the caller arrays and
+// its route id once the duplicates are known.
+typedef struct
+{
+	const char *p;
+	unsigned int idx;
+	unsigned int id;
+} ur_build_entry;
+
+// Id of the entries rejected because the same route comes earlier
+#define UR_BUILD_DUP ((unsigned int)-1)
+
+typedef struct
+{
+	urlrouter *router;
+	const char **routes;
+	const void **data;
+	int *errs;
+	// End of the routes, route `id` is stored at routes_end[-1 - id]
+	urlrouter_route *routes_end;
+} ur_build_ctx;
+
+static inline int ur_entry_sym(const ur_build_entry *e, unsigned int *width)
+{
+	return ur_path_sym(e->p, width);
+}
+
+// Advance `e` by `syms` symbols and return the number of bytes consumed.
+static inline unsigned int ur_entry_advance(ur_build_entry *e, unsigned int syms)
+{
+	const char *start = e->p;
+	unsigned int w;
+	while (syms--)
+	{
+		ur_entry_sym(e, &w);
+		e->p += w;
+	}
+	return e->p - start;
+}
+
+// Number of symbols shared by `a` and `b` from their current offsets.
+static inline unsigned int ur_entry_lcp(const ur_build_entry *a, const ur_build_entry *b)
+{
+	const char *pa = a->p, *pb = b->p;
+	unsigned int n = 0, wa, wb;
+	int sa;
+	while ((sa = ur_path_sym(pa, &wa)) == ur_path_sym(pb, &wb) && sa != UR_SYM_END)
+	{
+		pa += wa;
+		pb += wb;
+		n++;
+	}
+	return n;
+}
+
+static inline void ur_entry_swap(ur_build_entry *e, unsigned long i, unsigned long j)
+{
+	ur_build_entry tmp = e[i];
+	e[i] = e[j];
+	e[j] = tmp;
+}
+
+// Three-way partition of [lo, hi) on the symbol of its middle entry. The entries equal
+// to the pivot end up in [lt, gt) and are advanced past it. If the pivot is UR_SYM_END
+// they are all the same route: the first added one is moved to `lt` and the others are
+// flagged as duplicates.
+static inline int ur_build_partition(ur_build_entry *e, unsigned long lo, unsigned long hi,
+									 unsigned long *lt, unsigned long *gt)
+{
+	unsigned int w;
+	int pivot = ur_entry_sym(&e[lo + (hi - lo) / 2], &w);
+	unsigned long i = lo;
+	*lt = lo;
+	*gt = hi;
+	while (i < *gt)
+	{
+		int sym = ur_entry_sym(&e[i], &w);
+		if (sym < pivot)
+			ur_entry_swap(e, (*lt)++, i++);
+		else if (sym > pivot)
+			ur_entry_swap(e, i, --*gt);
+		else
+			i++;
+	}
+	for (i = *lt; i < *gt; i++)
+	{
+		if (pivot != UR_SYM_END)
+			ur_entry_advance(&e[i], 1);
+		else if (i > *lt)
+		{
+			if (e[i].idx < e[*lt].idx)
+				ur_entry_swap(e, *lt, i);
+			e[i].id = UR_BUILD_DUP;
+		}
+	}
+	return pivot;
+}
+
+// Multikey quicksort of the entries by symbol sequence. The entries are left
+// advanced and must be reset before building.
+static inline void ur_build_sort(ur_build_entry *e, unsigned long lo, unsigned long hi)
+{
+	while (hi - lo > 1)
+	{
+		unsigned long lt, gt;
+		int pivot = ur_build_partition(e, lo, hi, &lt, &gt);
+		ur_build_sort(e, lo, lt);
+		ur_build_sort(e, gt, hi);
+		if (pivot == UR_SYM_END) // Only duplicates remain
+			return;
+		lo = lt;
+		hi = gt;
+	}
+}
+
+// Give the sorted entries their route id, in the order of the caller arrays, and reset
+// them to the start of their route. The space reserved for the `n` routes is used as
+// scratch. Returns the number of routes.
+static inline unsigned int ur_build_ids(const ur_build_ctx *ctx, ur_build_entry *e, unsigned long m,
+										unsigned long n)
+{
+	unsigned int *rank = (unsigned int *)(ctx->routes_end - n);
+	unsigned int cnt = 0;
+	for (unsigned long i = 0; i < n; i++)
+		rank[i] = 0;
+	for (unsigned long i = 0; i < m; i++)
+		rank[e[i].idx] = e[i].id != UR_BUILD_DUP;
+	for (unsigned long i = 0; i < n; i++)
+		rank[i] = rank[i] ? cnt++ : UR_BUILD_DUP;
+
+	for (unsigned long i = 0; i < m; i++)
+	{
+		e[i].p = ctx->routes[e[i].idx];
+		if (e[i].id == UR_BUILD_DUP && ctx->errs)
+			ctx->errs[e[i].idx] = URLROUTER_ERR_PATH_EXISTS;
+		else if (e[i].id != UR_BUILD_DUP)
+			e[i].id = rank[e[i].idx];
+	}
+	return cnt;
+}
+
+// Compile the routes of the entries [lo, hi) one after the other from `mem`.
+// If `mem` is NULL, only compute their size. Returns the number of bytes used.
+static inline unsigned long ur_build_routes(const ur_build_ctx *ctx, const ur_build_entry *e,
+											unsigned long lo, unsigned long hi, char *mem)
+{
+	unsigned long size = 0;
+	for (unsigned long i = lo; i < hi; i++)
+	{
+		if (e[i].id == UR_BUILD_DUP)
+			continue;
+		if (mem)
+			ur_fill_route(ctx->routes_end - 1 - e[i].id, e[i].p, mem + size);
+		size += ur_template_size(e[i].p);
+	}
+	return size;
+}
+
+// A subtree left to be built by a worker thread: the sorted entries [lo, hi) are
+// the children of `parent`.
+typedef struct
+{
+	urlrouter_node *parent;
+	unsigned long lo, hi;
+} ur_build_task;
+
+// When building the top of the tree for urlrouter_build_parallel, child ranges of at
+// most `grain` entries are not built but stored as tasks.
+typedef struct
+{
+	ur_build_task *tasks;
+	unsigned long cnt, cap, grain;
+} ur_build_split;
+
+// Build the sibling chain for the sorted entries [lo, hi). All entries share
+// the symbols before their current offset and none of them is exhausted.
+// If `split` is set, small child ranges are stored as tasks instead of being built.
+// Returns NULL and sets `err` if the buffer is full.
+static inline urlrouter_node *ur_build_level(const ur_build_ctx *ctx, ur_build_entry *e,
+											 unsigned long lo, unsigned long hi,
+											 ur_build_split *split, int *err)
+{
+	urlrouter_node *head = NULL, *last = NULL;
+	unsigned int w;
+	while (lo < hi)
+	{
+		// Group the entries starting with the same symbol, they will share a node
+		int sym = ur_entry_sym(&e[lo], &w);
+		unsigned long end = lo + 1;
+		while (end < hi && ur_entry_sym(&e[end], &w) == sym)
+			end++;
+
+		// The node holds the common prefix of the first and last entries of the group, up to
+		// the end of its first token
+		const char *frag;
+		unsigned int frag_len, kind;
+		ur_token(e[lo].p, ur_entry_lcp(&e[lo], &e[end - 1]), &frag, &frag_len, &kind);
+		urlrouter_node *node = ur_create_node(ctx->router, frag, frag_len, NULL, 0);
+		if (node == NULL)
+		{
+			*err = URLROUTER_ERR_BUFF_FULL;
+			return NULL;
+		}
+		node->kind = kind;
+		for (unsigned long i = lo; i < end; i++)
+			ur_entry_advance(&e[i], kind == URLROUTER_NODE_PARAM ? 1 : frag_len);
+
+		// Exhausted entries sort first, starting with the one that is not a duplicate
+		unsigned long child = lo;
+		while (child < end && ur_entry_sym(&e[child], &w) == UR_SYM_END)
+			child++;
+		if (child > lo)
+		{
+			node->data = ctx->data[e[lo].idx];
+			node->id = e[lo].id;
+		}
+
+		if (child < end && split && end - child <= split->grain && split->cnt < split->cap)
+		{
+			ur_build_task *task = &split->tasks[split->cnt++];
+			task->parent = node;
+			task->lo = child;
+			task->hi = end;
+		}
+		else if (child < end)
+		{
+			node->first_child = ur_build_level(ctx, e, child, end, split, err);
+			if (node->first_child == NULL)
+				return NULL;
+		}
+
+		if (last)
+			last->next_sibling = node;
+		else
+			head = node;
+		last = node;
+		lo = end;
+	}
+	return head;
+}
+
+// Set the number of routes once they are all compiled
+static inline void ur_set_routes(urlrouter *router, unsigned int route_cnt)
+{
+	router->generation++;
+	router->dfa = NULL;
+	router->route_cnt = route_cnt;
+	router->id_cnt = route_cnt;
+	for (unsigned int i = 0; i < route_cnt; i++)
+	{
+		ur_get_route(router, i)->id = i;
+		if (ur_get_route(router, i)->param_cnt > router->max_params)
+			router->max_params = ur_get_route(router, i)->param_cnt;
+		ur_filter_add(&router->filter, ur_get_route(router, i));
+	}
+}
+
+// Insert the routes one by one in a router that already has some
+static inline int ur_build_add(urlrouter *router, const char **routes, const void **data,
+							   unsigned long n, int *errs)
+{
+	for (unsigned long i = 0; i < n; i++)
+	{
+		int err = urlrouter_add(router, routes[i], data[i]);
+		if (err == URLROUTER_ERR_BUFF_FULL)
+		{
+			// The routes added so far are kept, the nodes they split can't be restored
+			for (; errs && i < n; i++)
+				errs[i] = err;
+			return err;
+		}
+		if (errs)
+			errs[i] = err < 0 ? err : 0;
+	}
+	return ur_rem_space(router);
+}
+
+// Reserve the end of the buffer for the routes and the sort entries. While building,
+// router->len is lowered to the start of the entries.
+static inline ur_build_entry *ur_build_reserve(urlrouter *router, unsigned long n)
+{
+	unsigned long size = n * (sizeof(urlrouter_route) + sizeof(ur_build_entry));
+	if (size > router->len - router->cursor)
+		return NULL;
+	router->len -= size;
+	return (ur_build_entry *)((char *)router->buffer + router->len);
+}
+
+// Build the tree of an empty router, it is left empty on error
+static inline int ur_build(urlrouter *router, const char **routes, const void **data,
+						   unsigned long n, int *errs)
+{
+	unsigned long len = router->len, cursor = router->cursor;
+	ur_build_entry *entries = ur_build_reserve(router, n);
+	if (entries == NULL)
+		return URLROUTER_ERR_BUFF_FULL;
+	urlrouter_route *routes_end = (urlrouter_route *)((char *)router->buffer + len);
+	ur_build_ctx ctx = {router, routes, data, errs, routes_end};
+
+	unsigned long m = 0;
+	for (unsigned long i = 0; i < n; i++)
+	{
+		int err = ur_verify_path(routes[i], NULL);
+		if (errs)
+			errs[i] = err;
+		if (err == 0)
+			entries[m++] = (ur_build_entry){routes[i], i, 0};
+	}
+
+	ur_build_sort(entries, 0, m);
+	unsigned int route_cnt = ur_build_ids(&ctx, entries, m, n);
+
+	// Templates are stored first so that the nodes are contiguous
+	int err = 0;
+	char *templates = (char *)ur_alloc(router, ur_build_routes(&ctx, entries, 0, m, NULL));
+	if (templates == NULL)
+		err = URLROUTER_ERR_BUFF_FULL;
+	else
+	{
+		ur_build_routes(&ctx, entries, 0, m, templates);
+		router->root = ur_build_level(&ctx, entries, 0, m, NULL, &err);
+	}
+
+	router->len = len;
+	if (err != 0)
+	{
+		router->root = NULL;
+		router->cursor = cursor;
+		return err;
+	}
+	ur_set_routes(router, route_cnt);
+	return ur_rem_space(router);
+}
+
+URLROUTER_API int urlrouter_build(urlrouter *router, const char **routes, const void **data,
+								  unsigned long n, int *errs)
+{
+	ur_assert(routes != NULL && data != NULL);
+
+	// Nothing to gain when merging into an existing tree
+	if (router->root != NULL || router->route_cnt != 0)
+		return ur_build_add(router, routes, data, n, errs);
+
+	int err;
+	unsigned long size = 0;
+	while ((err = ur_build(router, routes, data, n, errs)) == URLROUTER_ERR_BUFF_FULL &&
+		   ur_grow(router, &size))
+		;
+	return err;
+}
+
+#ifdef URLROUTER_THREADS
+#ifndef URLROUTER_MAX_THREADS
+#define URLROUTER_MAX_THREADS 64
+#endif
+
+// Capacity of the work lists of urlrouter_build_parallel
+#define UR_BUILD_JOBS 256
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	unsigned long next, cnt;
+	void (*run)(void *ctx, unsigned long job);
+	void *ctx;
+} ur_job_queue;
+
+static inline void *ur_job_worker(void *arg)
+{
+	ur_job_queue *queue = (ur_job_queue *)arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&queue->lock);
+		unsigned long job = queue->next < queue->cnt ? queue->next++ : queue->cnt;
+		pthread_mutex_unlock(&queue->lock);
+		if (job == queue->cnt)
+			return NULL;
+		queue->run(queue->ctx, job);
+	}
+}
+
+// Run the jobs [0, cnt) on up to `threads` threads, the calling thread included.
+static inline void ur_run_jobs(unsigned int threads, unsigned long cnt,
+							   void (*run)(void *, unsigned long), void *ctx)
+{
+	pthread_t workers[URLROUTER_MAX_THREADS];
+	unsigned int spawned = 0;
+	ur_job_queue queue = {.next = 0, .cnt = cnt, .run = run, .ctx = ctx};
+	pthread_mutex_init(&queue.lock, NULL);
+
+	if (threads > URLROUTER_MAX_THREADS)
+		threads = URLROUTER_MAX_THREADS;
+	while (spawned + 1 < threads && spawned + 1 < cnt &&
+		   pthread_create(&workers[spawned], NULL, ur_job_worker, &queue) == 0)
+		spawned++;
+	ur_job_worker(&queue);
+	while (spawned)
+		pthread_join(workers[--spawned], NULL);
+	pthread_mutex_destroy(&queue.lock);
+}
+
+typedef struct
+{
+	unsigned long lo, hi;
+	ur_bool sorted;
+} ur_build_range;
+
+typedef struct
+{
+	ur_build_ctx ctx;
+	ur_build_entry *entries;
+	// Chunk size of the verified routes and of the compiled entries
+	unsigned long n, chunk, m, entry_chunk;
+	// Number of accepted routes in each verified chunk, then offset of the templates of
+	// each chunk of entries
+	unsigned long accepted[UR_BUILD_JOBS];
+	char *templates;
+	ur_build_range ranges[UR_BUILD_JOBS];
+	ur_build_task tasks[UR_BUILD_JOBS];
+	// Byte offset of the region reserved for each task and its size, then the number of bytes
+	// the task used. `full` is set if the region was too small.
+	unsigned long region[UR_BUILD_JOBS], used[UR_BUILD_JOBS];
+	ur_bool full[UR_BUILD_JOBS];
+} ur_parallel_build;
+
+static inline void ur_verify_job(void *arg, unsigned long job)
+{
+	ur_parallel_build *pb = (ur_parallel_build *)arg;
+	unsigned long lo = job * pb->chunk, hi = lo + pb->chunk < pb->n ? lo + pb->chunk : pb->n;
+	unsigned long m = lo;
+	for (unsigned long i = lo; i < hi; i++)
+	{
+		int err = ur_verify_path(pb->ctx.routes[i], NULL);
+		if (pb->ctx.errs)
+			pb->ctx.errs[i] = err;
+		if (err == 0)
+			pb->entries[m++] = (ur_build_entry){pb->ctx.routes[i], i, 0};
+	}
+	pb->accepted[job] = m - lo;
+}
+
+static inline void ur_sort_job(void *arg, unsigned long job)
+{
+	ur_parallel_build *pb = (ur_parallel_build *)arg;
+	if (!pb->ranges[job].sorted)
+		ur_build_sort(pb->entries, pb->ranges[job].lo, pb->ranges[job].hi);
+}
+
+static inline void ur_size_templates_job(void *arg, unsigned long job)
+{
+	ur_parallel_build *pb = (ur_parallel_build *)arg;
+	unsigned long lo = job * pb->entry_chunk;
+	unsigned long hi = lo + pb->entry_chunk < pb->m ? lo + pb->entry_chunk : pb->m;
+	pb->accepted[job] = ur_build_routes(&pb->ctx, pb->entries, lo, hi, NULL);
+}
+
+static inline void ur_routes_job(void *arg, unsigned long job)
+{
+	ur_parallel_build *pb = (ur_parallel_build *)arg;
+	unsigned long lo = job * pb->entry_chunk;
+	unsigned long hi = lo + pb->entry_chunk < pb->m ? lo + pb->entry_chunk : pb->m;
+	ur_build_routes(&pb->ctx, pb->entries, lo, hi, pb->templates + pb->accepted[job]);
+}
+
+static inline void ur_build_job(void *arg, unsigned long job)
+{
+	ur_parallel_build *pb = (ur_parallel_build *)arg;
+	ur_build_task *task = &pb->tasks[job];
+	urlrouter region;
+	urlrouter_init(&region, (char *)pb->ctx.router->buffer + pb->region[job], pb->used[job]);
+	ur_build_ctx ctx = pb->ctx;
+	ctx.router = &region;
+
+	int err = 0;
+	task->parent->first_child = ur_build_level(&ctx, pb->entries, task->lo, task->hi, NULL, &err);
+	pb->full[job] = err != 0;
+	pb->used[job] = region.cursor;
+}
+
+// Size of the region of a task. A radix tree of k routes has at most 2k - 1 nodes, and a
+// route with p params adds at most 2p node boundaries. Escaped braces and long fragments
+// add more, the region may then be full.
+static inline unsigned long ur_task_size(const ur_parallel_build *pb, const ur_build_task *task)
+{
+	unsigned long cnt = 0;
+	for (unsigned long i = task->lo; i < task->hi; i++)
+	{
+		unsigned int id = pb->entries[i].id;
+		cnt += 2 + (id != UR_BUILD_DUP ? 2 * pb->ctx.routes_end[-1 - (long)id].param_cnt : 0);
+	}
+	return cnt * sizeof(urlrouter_node);
+}
+
+// Partition the m accepted entries into ranges of at most `grain` entries that can be
+// sorted independently. Returns the number of ranges.
+static inline unsigned long ur_split_ranges(ur_parallel_build *pb, unsigned long m,
+											unsigned long grain)
+{
+	ur_build_range *ranges = pb->ranges;
+	unsigned long cnt = 1;
+	ranges[0].lo = 0;
+	ranges[0].hi = m;
+	ranges[0].sorted = 0;
+	while (cnt + 2 <= UR_BUILD_JOBS)
+	{
+		// Split the largest range first
+		unsigned long b = cnt;
+		for (unsigned long i = 0; i < cnt; i++)
+		{
+			unsigned long size = ranges[i].hi - ranges[i].lo;
+			if (!ranges[i].sorted && size > grain &&
+				(b == cnt || size > ranges[b].hi - ranges[b].lo))
+				b = i;
+		}
+		if (b == cnt)
+			break;
+
+		unsigned long lo = ranges[b].lo, hi = ranges[b].hi, lt, gt;
+		int pivot = ur_build_partition(pb->entries, lo, hi, &lt, &gt);
+		ranges[b].lo = lt;
+		ranges[b].hi = gt;
+		ranges[b].sorted = pivot == UR_SYM_END;
+		if (lt > lo)
+			ranges[cnt++] = (ur_build_range){lo, lt, 0};
+		if (hi > gt)
+			ranges[cnt++] = (ur_build_range){gt, hi, 0};
+	}
+	return cnt;
+}
+
+// Move the node regions built by the tasks right after the top of the tree and
+// relocate their pointers.
+static inline void ur_compact_regions(urlrouter *router, ur_parallel_build *pb,
+									  unsigned long task_cnt)
+{
+	unsigned long cursor = router->cursor;
+	for (unsigned long t = 0; t < task_cnt; t++)
+	{
+		urlrouter_node *from = (urlrouter_node *)((char *)router->buffer + pb->region[t]);
+		urlrouter_node *to = (urlrouter_node *)((char *)router->buffer + cursor);
+		unsigned long used = pb->used[t] / sizeof(urlrouter_node);
+		for (unsigned long i = 0; to != from && i < used; i++)
+		{
+			to[i] = from[i];
+			if (to[i].first_child)
+				to[i].first_child = to + (to[i].first_child - from);
+			if (to[i].next_sibling)
+				to[i].next_sibling = to + (to[i].next_sibling - from);
+		}
+		if (pb->tasks[t].parent->first_child)
+			pb->tasks[t].parent->first_child = to + (pb->tasks[t].parent->first_child - from);
+		cursor += pb->used[t];
+	}
+	router->cursor = cursor;
+}
+
+// Same as ur_build on `threads` threads
+static inline int ur_build_parallel(urlrouter *router, const char **routes, const void **data,
+									unsigned long n, int *errs, unsigned int threads)
+{
+	unsigned long len = router->len, cursor = router->cursor;
+	ur_parallel_build pb;
+	pb.entries = ur_build_reserve(router, n);
+	if (pb.entries == NULL)
+		return URLROUTER_ERR_BUFF_FULL;
+	urlrouter_route *routes_end = (urlrouter_route *)((char *)router->buffer + len);
+	pb.ctx = (ur_build_ctx){router, routes, data, errs, routes_end};
+	pb.n = n;
+
+	// Verify the routes by chunks, then gather the accepted ones
+	unsigned long jobs = threads * 4 < UR_BUILD_JOBS ? threads * 4 : UR_BUILD_JOBS;
+	pb.chunk = (n + jobs - 1) / jobs;
+	jobs = (n + pb.chunk - 1) / pb.chunk;
+	ur_run_jobs(threads, jobs, ur_verify_job, &pb);
+	unsigned long m = 0;
+	for (unsigned long j = 0; j < jobs; j++)
+		for (unsigned long i = 0; i < pb.accepted[j]; i++)
+			pb.entries[m++] = pb.entries[j * pb.chunk + i];
+
+	// Sort independent ranges of entries in parallel
+	unsigned long grain = m / (threads * 8) + 1;
+	ur_run_jobs(threads, ur_split_ranges(&pb, m, grain), ur_sort_job, &pb);
+	unsigned int route_cnt = ur_build_ids(&pb.ctx, pb.entries, m, n);
+
+	// Compile the templates by chunks of entries
+	int err = 0;
+	pb.m = m;
+	pb.entry_chunk = m / jobs + 1;
+	jobs = (m + pb.entry_chunk - 1) / pb.entry_chunk;
+	ur_run_jobs(threads, jobs, ur_size_templates_job, &pb);
+	unsigned long size = 0;
+	for (unsigned long j = 0; j < jobs; j++)
+	{
+		unsigned long job_size = pb.accepted[j];
+		pb.accepted[j] = size;
+		size += job_size;
+	}
+	pb.templates = (char *)ur_alloc(router, size);
+	if (pb.templates == NULL)
+		err = URLROUTER_ERR_BUFF_FULL;
+	else
+		ur_run_jobs(threads, jobs, ur_routes_job, &pb);
+
+	// Build the top of the tree and leave the small subtrees to the workers. Each of them
+	// gets a region big enough for its worst case, the regions are compacted afterwards.
+	ur_build_split split = {pb.tasks, 0, UR_BUILD_JOBS, grain};
+	unsigned long top = router->cursor, end = top;
+	if (err == 0)
+	{
+		router->root = ur_build_level(&pb.ctx, pb.entries, 0, m, &split, &err);
+		end = router->cursor;
+	}
+	for (unsigned long t = 0; t < split.cnt; t++)
+	{
+		pb.region[t] = end;
+		pb.used[t] = ur_task_size(&pb, &split.tasks[t]);
+		end += pb.used[t];
+	}
+
+	ur_bool full = end > router->len;
+	if (err == 0 && !full)
+	{
+		ur_run_jobs(threads, split.cnt, ur_build_job, &pb);
+		for (unsigned long t = 0; t < split.cnt; t++)
+			full |= pb.full[t];
+		if (!full)
+			ur_compact_regions(router, &pb, split.cnt);
+	}
+	if (err == 0 && full)
+	{
+		// Not enough room for the worst case, build the whole tree sequentially
+		for (unsigned long i = 0; i < m; i++)
+			pb.entries[i].p = routes[pb.entries[i].idx];
+		router->cursor = top;
+		router->root = ur_build_level(&pb.ctx, pb.entries, 0, m, NULL, &err);
+	}
+
+	router->len = len;
+	if (err != 0)
+	{
+		router->root = NULL;
+		router->cursor = cursor;
+		return err;
+	}
+	ur_set_routes(router, route_cnt);
+	return ur_rem_space(router);
+}
+
+URLROUTER_API int urlrouter_build_parallel(urlrouter *router, const char **routes,
+										   const void **data, unsigned long n, int *errs,
+										   unsigned int threads)
+{
+	ur_assert(routes != NULL && data != NULL);
+	if (threads <= 1 || n == 0)
+		return urlrouter_build(router, routes, data, n, errs);
+	if (router->root != NULL || router->route_cnt != 0)
+		return ur_build_add(router, routes, data, n, errs);
+
+	int err;
+	unsigned long size = 0;
+	while ((err = ur_build_parallel(router, routes, data, n, errs, threads)) ==
+			   URLROUTER_ERR_BUFF_FULL &&
+		   ur_grow(router, &size))
+		;
+	return err;
+}
+#endif // URLROUTER_THREADS
+
+// Advance `p` by one byte. When the end of the host is reached, continue with the path.
+static inline const char *ur_next_byte(const char *p, ur_bool *in_host, const char *path)
+{
+	if (*in_host && *++p == '\0')
+	{
+		*in_host = 0;
+		return path;
+	}
+	return *in_host ? p : p + 1;
+}
+
+// The router owning the routes below the last mount passed by a lookup, the number of params
+// before that mount and the id in the looked up router of the first route of its owner
+typedef struct
+{
+	const urlrouter *router;
+	unsigned int param_i;
+	unsigned int id_base;
+} ur_mount_hit;
+
+// Pass the mount at `node` in the router owning it
+static inline void ur_pass_mount(ur_mount_hit *hit, const urlrouter_node *node,
+								 unsigned int param_i)
+{
+	const struct urlrouter_mount *m = hit->router->mounts;
+	while (m->node != node)
+		m = m->next;
+	hit->id_base += m->id_base;
+	hit->router = m->sub;
+	hit->param_i = param_i;
+}
+
+// Look up `path` in the tree at `node` and return the node where it ends, if any. If `host`
+// is set, the key is the host followed by the path, and a host param ends at the next '.'.
+// Without `check_len`, `params` must have room for the params of any route. If `hit` is set,
+// it is updated with the mounts passed.
+static inline urlrouter_node *ur_find_node(urlrouter_node *node, const char *host, const char *path,
+										   urlparam *params, const unsigned int len,
+										   unsigned int *param_cnt, const ur_bool check_len,
+										   ur_mount_hit *hit)
+{
+	// cannot have param_cnt set but not params
+	ur_assert((params != NULL && param_cnt != NULL) || params == NULL);
+
+	ur_bool in_host = host != NULL && *host != '\0';
+	const char *p = in_host ? host : path;
+	unsigned int param_i = 0;
+	if (!node)
+		return NULL;
+
+	// Where the current node started to match, a sibling is tried from there
+	const char *node_p = p;
+	ur_bool node_in_host = in_host;
+	unsigned int node_param_i = 0, node_param_cnt = param_cnt ? *param_cnt : 0;
+
+	// We iterate over the path
+	while (*p)
+	{
+		ur_bool matched;
+		if (node->kind == URLROUTER_NODE_PARAM)
+		{
+			// A param matches at least one byte, up to the next '/'
+			matched = *p != '/';
+			if (matched)
+			{
+				if (params && (!check_len || param_i < len))
+				{
+					params[param_i].value = p;
+					params[param_i].len = 1;
+					if (param_cnt)
+						++*param_cnt;
+				}
+				p = ur_next_byte(p, &in_host, path);
+				while (*p != '/' && *p != '\0' && !(in_host && *p == '.'))
+				{
+					if (params && (!check_len || param_i < len))
+						params[param_i].len++;
+					p = ur_next_byte(p, &in_host, path);
+				}
+				param_i++;
+			}
+		}
+		else
+		{
+			const char *frag = node->frag, *frag_end = frag + node->frag_len;
+			while (frag != frag_end && *frag == *p)
+			{
+				frag++;
+				p = ur_next_byte(p, &in_host, path);
+			}
+			matched = frag == frag_end;
+		}
+
+		if (matched && *p == '\0')
+			return node;
+		else if (matched && node->first_child)
+		{
+			if (hit && node->mount)
+				ur_pass_mount(hit, node, param_i);
+			node = node->first_child;
+			node_p = p;
+			node_in_host = in_host;
+			node_param_i = param_i;
+			if (param_cnt)
+				node_param_cnt = *param_cnt;
+		}
+		else if (node->next_sibling)
+		{
+			// Undo the partial match, the sibling may be a param matching it
+			node = node->next_sibling;
+			p = node_p;
+			in_host = node_in_host;
+			param_i = node_param_i;
+			if (param_cnt)
+				*param_cnt = node_param_cnt;
+		}
+		else
+			return NULL;
+	}
+
+	return NULL;
+}
+
+// A DFA compiled from the tree by urlrouter_set_engine. The rows of the table are indexed by
+// their offset in the table, so a transition is a single load.
+struct urlrouter_dfa
+{
+	// Class of each byte, bytes that don't appear in the routes share class 0
+	unsigned char classes[256];
+	unsigned int class_cnt;
+	unsigned int state_cnt;
+	// One row per state: the offset of the next state for each class, then the id + 1 of the
+	// route matched if the path ends in this state, or 0. Row 0 is the dead state and row 1
+	// the start state.
+	const unsigned int *table;
+	// Node of each route, by id
+	const urlrouter_node **nodes;
+	// Cursor of the router before the DFA was compiled
+	unsigned long cursor;
+};
+
+// Same as ur_find_node on the root with the DFA of the router. The params are read from the
+// template of the matched route: its literal pieces are skipped and a param ends at the next
+// '/', like it does in the tree.
+static inline urlrouter_node *ur_dfa_find(const urlrouter *router, const char *path,
+										  urlparam *params, const unsigned int len,
+										  unsigned int *param_cnt, const ur_bool check_len)
+{
+	const struct urlrouter_dfa *dfa = router->dfa;
+	const unsigned int *table = dfa->table;
+	unsigned int state = dfa->class_cnt + 1;
+	for (const unsigned char *p = (const unsigned char *)path; *p != '\0' && state != 0; p++)
+		state = table[state + dfa->classes[*p]];
+
+	unsigned int accept = table[state + dfa->class_cnt];
+	if (accept == 0)
+		return NULL;
+	const urlrouter_node *node = dfa->nodes[accept - 1];
+	if (params == NULL)
+		return (urlrouter_node *)node;
+
+	const urlrouter_route *route = ur_get_route(router, accept - 1);
+	const char *p = path;
+	for (unsigned int i = 0, param_i = 0; i < route->piece_cnt; i++)
+	{
+		if (!route->pieces[i].is_param)
+		{
+			p += route->pieces[i].len;
+			continue;
+		}
+		const char *value = p;
+		while (*p != '/' && *p != '\0')
+			p++;
+		if (!check_len || param_i < len)
+		{
+			params[param_i].value = value;
+			params[param_i].len = p - value;
+			if (param_cnt)
+				++*param_cnt;
+		}
+		param_i++;
+	}
+	return (urlrouter_node *)node;
+}
+
+// Look up `path` in the routes added without host, with the DFA if there is one. Otherwise
+// the paths rejected by the filter are not looked up.
+static inline urlrouter_node *ur_find_root(const urlrouter *router, const char *path,
+										  urlparam *params, const unsigned int len,
+										  unsigned int *param_cnt, const ur_bool check_len,
+										  ur_mount_hit *hit)
+{
+	if (router->dfa != NULL)
+		return ur_dfa_find(router, path, params, len, param_cnt, check_len);
+	if (ur_filter_rejects(&router->filter, path))
+		return NULL;
+	return ur_find_node(router->root, NULL, path, params, len, param_cnt, check_len, hit);
+}
+
+URLROUTER_API const void *urlrouter_find(const urlrouter *router, const char *path,
+										 urlparam *params, const unsigned int len,
+										 unsigned int *param_cnt)
+{
+	urlrouter_node *node = ur_find_root(router, path, params, len, param_cnt, 1, NULL);
+	return node ? node->data : NULL;
+}
+
+URLROUTER_API int urlrouter_find_id(const urlrouter *router, const char *path,
+									urlparam *params, const unsigned int len,
+									unsigned int *param_cnt)
+{
+	ur_mount_hit hit = {router, 0, 0};
+	urlrouter_node *node = ur_find_root(router, path, params, len, param_cnt, 1, &hit);
+	if (node == NULL || node->data == NULL)
+		return URLROUTER_ERR_NOT_FOUND;
+	return (int)(hit.id_base + ur_get_route(hit.router, node->id)->id);
+}
+
+URLROUTER_API unsigned int urlrouter_id_cnt(const urlrouter *router)
+{
+	return router->id_cnt;
+}
+
+URLROUTER_API const void *urlrouter_find_noparams(const urlrouter *router, const char *path)
+{
+	urlrouter_node *node = ur_find_root(router, path, NULL, 0, NULL, 0, NULL);
+	return node ? node->data : NULL;
+}
+
+URLROUTER_API int urlrouter_exists(const urlrouter *router, const char *path)
+{
+	urlrouter_node *node = ur_find_root(router, path, NULL, 0, NULL, 0, NULL);
+	return node != NULL && node->data != NULL;
+}
+
+URLROUTER_API const void *urlrouter_find_fixed(const urlrouter *router, const char *path,
+											   urlparam *params, unsigned int *param_cnt)
+{
+	// A local counter can stay in a register
+	unsigned int cnt = 0;
+	urlrouter_node *node = ur_find_root(router, path, params, 0, &cnt, 0, NULL);
+	*param_cnt = cnt;
+	return node ? node->data : NULL;
+}
+
+// The host and the path are walked as one key, whose path starts at the first '/'. A host with
+// a '/' or a path without leading '/' would move bytes across that boundary.
+static inline ur_bool ur_valid_host_key(const char *host, const char *path)
+{
+	if (*path != '/')
+		return 0;
+	while (*host != '\0' && *host != '/')
+		host++;
+	return *host == '\0';
+}
+
+// Find the node of the route matching `host` and `path`. Without host, only the routes
+// added without host are searched.
+static inline urlrouter_node *ur_find_route(const urlrouter *router, const char *host,
+											const char *path, urlparam *params,
+											const unsigned int len, unsigned int *param_cnt,
+											ur_mount_hit *hit)
+{
+	unsigned int cnt = param_cnt ? *param_cnt : 0;
+	if (host != NULL && ur_valid_host_key(host, path))
+	{
+		urlrouter_node *node =
+			ur_find_node(router->host_root, host, path, params, len, param_cnt, 1, NULL);
+		if (node != NULL && node->data != NULL)
+			return node;
+
+		// Routes without host match any host
+		if (param_cnt)
+			*param_cnt = cnt;
+	}
+	return ur_find_root(router, path, params, len, param_cnt, 1, hit);
+}
+
+URLROUTER_API const void *urlrouter_find_host(const urlrouter *router, const char *host,
+											  const char *path, urlparam *params,
+											  const unsigned int len, unsigned int *param_cnt)
+{
+	ur_assert(host != NULL && path != NULL);
+	urlrouter_node *node = ur_find_route(router, host, path, params, len, param_cnt, NULL);
+	return node ? node->data : NULL;
+}
+
+URLROUTER_API const void *urlrouter_find_match(const urlrouter *router, const char *host,
+											   const char *path, urlparam *params,
+											   const unsigned int len, urlrouter_match *match)
+{
+	match->params = params;
+	match->param_cnt = 0;
+	ur_mount_hit hit = {router, 0, 0};
+	urlrouter_node *node =
+		ur_find_route(router, host, path, params, len, &match->param_cnt, &hit);
+	match->router = node && node->data ? router : NULL;
+	match->route = match->router ? ur_get_route(hit.router, node->id)->id : 0;
+	match->id = hit.id_base + match->route;
+	match->data = node ? node->data : NULL;
+	if (match->router && hit.router != router)
+	{
+		// The route and its param names are the ones of the mounted router
+		unsigned int skip = hit.param_i < match->param_cnt ? hit.param_i : match->param_cnt;
+		match->router = hit.router;
+		match->params += skip;
+		match->param_cnt -= skip;
+	}
+	return match->data;
+}
+
+// Find the slot of `key` in the param name table of the matched route
+static inline const urlrouter_param_slot *ur_find_slot(const urlrouter_match *match,
+													   const urlrouter_route **route,
+													   unsigned int key)
+{
+	if (match->router == NULL)
+		return NULL;
+	const urlrouter_route *r = *route =
+		ur_get_route(match->router, ur_route_index(match->router, match->route));
+	if (r->param_cnt == 0)
+		return NULL;
+
+	const urlrouter_param_slot *slots = (const urlrouter_param_slot *)(r->pieces + r->piece_cnt);
+	for (unsigned int i = key & r->slot_mask; slots[i].index != 0; i = (i + 1) & r->slot_mask)
+	{
+		if (slots[i].key == key)
+			return &slots[i];
+	}
+	return NULL;
+}
+
+URLROUTER_API const urlparam *urlrouter_param_get_key(const urlrouter_match *match,
+													  unsigned int key)
+{
+	const urlrouter_route *r;
+	const urlrouter_param_slot *slot = ur_find_slot(match, &r, key);
+	if (slot == NULL || slot->index > match->param_cnt)
+		return NULL;
+	return &match->params[slot->index - 1];
+}
+
+URLROUTER_API const urlparam *urlrouter_param_get(const urlrouter_match *match,
+												  const char *name)
+{
+	const urlrouter_route *r;
+	const urlrouter_param_slot *slot = ur_find_slot(match, &r, urlrouter_param_key(name));
+	if (slot == NULL || slot->index > match->param_cnt)
+		return NULL;
+
+	// Another name with the same key is not a param of the route
+	const urlrouter_piece *piece = &r->pieces[slot->piece];
+	for (unsigned int i = 0; i < piece->len; i++)
+	{
+		if (name[i] != piece->str[i])
+			return NULL;
+	}
+	return name[piece->len] == '\0' ? &match->params[slot->index - 1] : NULL;
+}
+
+URLROUTER_API int urlrouter_url_for(const urlrouter *router, unsigned int route,
+									const urlparam *params, unsigned int n, char *out,
+									unsigned long out_len)
+{
+	unsigned int i = ur_route_index(router, route);
+	if (i == router->route_cnt)
+		return URLROUTER_ERR_NOT_FOUND;
+	const urlrouter_route *r = ur_get_route(router, i);
+	if (n < r->param_cnt)
+		return URLROUTER_ERR_MISSING_PARAM;
+	ur_assert(params != NULL || r->param_cnt == 0);
+
+	unsigned long total = r->len;
+	for (unsigned int i = 0; i < r->param_cnt; i++)
+		total += params[i].len;
+	if (total >= out_len)
+		return total;
+
+	unsigned int param_i = 0;
+	for (unsigned int i = 0; i < r->piece_cnt; i++)
+	{
+		const char *s = r->pieces[i].str;
+		unsigned int len = r->pieces[i].len;
+		if (r->pieces[i].is_param)
+		{
+			s = params[param_i].value;
+			len = params[param_i++].len;
+		}
+		for (unsigned int j = 0; j < len; j++)
+			*out++ = s[j];
+	}
+	*out = '\0';
+	return total;
+}
+
+// Results of ur_step_node
+#define UR_STEP_DEAD 0
+#define UR_STEP_BYTE 1
+#define UR_STEP_PARAM_START 2
+#define UR_STEP_PARAM 3
+#define UR_STEP_DESCEND 4
+
+// Number of steps to fully match a node: one per byte of a static fragment, one for a param
+static inline unsigned int ur_node_steps(const urlrouter_node *node)
+{
+	return node->kind == URLROUTER_NODE_PARAM ? 1 : node->frag_len;
+}
+
+// Match the byte `c` at offset `off` of `node`. It is the byte by byte version of
+// ur_find_node: a param matches up to the next '/', and when the node is fully matched the
+// next byte has to be matched by its children (UR_STEP_DESCEND). `in_param` tells if the
+// previous byte was part of a param.
+static inline int ur_step_node(const urlrouter_node *node, unsigned char *off,
+							   unsigned char *in_param, char c)
+{
+	if (*in_param)
+	{
+		if (c != '/')
+			return UR_STEP_PARAM;
+		*in_param = 0;
+	}
+	if (*off == ur_node_steps(node))
+		return node->first_child ? UR_STEP_DESCEND : UR_STEP_DEAD;
+
+	// A param matches at least one byte
+	if (node->kind == URLROUTER_NODE_PARAM)
+	{
+		if (c == '/')
+			return UR_STEP_DEAD;
+		*in_param = 1;
+		*off = 1;
+		return UR_STEP_PARAM_START;
+	}
+	if (node->frag[*off] != c)
+		return UR_STEP_DEAD;
+	++*off;
+	return UR_STEP_BYTE;
+}
+
+// ur_step_node for a matcher thread, the params are ranges of the chunk `chunk`
+static inline int ur_thread_step(urlrouter_matcher_thread *t, char c, unsigned int chunk,
+								 unsigned int off)
+{
+	int step = ur_step_node(t->node, &t->off, &t->in_param, c);
+	if (step == UR_STEP_PARAM && t->param_cnt <= URLROUTER_MATCHER_PARAMS)
+	{
+		t->params[t->param_cnt - 1].last_chunk = chunk;
+		t->params[t->param_cnt - 1].end = off + 1;
+		t->params[t->param_cnt - 1].len++;
+	}
+	else if (step == UR_STEP_PARAM_START)
+	{
+		if (t->param_cnt < URLROUTER_MATCHER_PARAMS)
+		{
+			urlrouter_chunk_param *param = &t->params[t->param_cnt];
+			param->first_chunk = param->last_chunk = chunk;
+			param->first = off;
+			param->end = off + 1;
+			param->len = 1;
+		}
+		t->param_cnt++;
+	}
+	return step;
+}
+
+// Start a thread for each node of the sibling chain `node` matching `c`, in order, after the
+// other threads. `from` holds the params matched before these nodes.
+static inline void ur_matcher_enter(urlrouter_matcher *m, const urlrouter_matcher_thread *from,
+									const urlrouter_node *node, char c, unsigned int off)
+{
+	for (; node != NULL; node = node->next_sibling)
+	{
+		// Only the nodes starting with `c` or with a param can match
+		if (node->kind == URLROUTER_NODE_STATIC && *node->frag != c)
+			continue;
+
+		urlrouter_matcher_thread t;
+		if (from != NULL)
+			t = *from;
+		else
+			t.param_cnt = 0;
+		t.node = node;
+		t.off = 0;
+		t.in_param = 0;
+		if (ur_thread_step(&t, c, m->chunk, off) == UR_STEP_DEAD)
+			continue;
+		if (m->thread_cnt == URLROUTER_MATCHER_THREADS)
+		{
+			m->err = URLROUTER_ERR_BUFF_FULL;
+			return;
+		}
+		m->threads[m->thread_cnt++] = t;
+	}
+}
+
+URLROUTER_API void urlrouter_match_begin(urlrouter_matcher *matcher, const urlrouter *router)
+{
+	matcher->router = router;
+	matcher->thread_cnt = 0;
+	matcher->chunk = 0;
+	matcher->started = 0;
+	matcher->err = 0;
+}
+
+URLROUTER_API int urlrouter_match_feed(urlrouter_matcher *matcher, const char *chunk,
+									   unsigned long len)
+{
+	urlrouter_matcher *m = matcher;
+	for (unsigned long i = 0; i < len && m->err == 0; i++)
+	{
+		if (!m->started)
+		{
+			m->started = 1;
+			ur_matcher_enter(m, NULL, m->router->root, chunk[i], i);
+			continue;
+		}
+		if (m->thread_cnt == 0)
+			break;
+
+		// The threads are in the order ur_find_node would try their nodes
+		for (unsigned int t = 0; t < m->thread_cnt;)
+		{
+			int step = ur_thread_step(&m->threads[t], chunk[i], m->chunk, i);
+			if (step != UR_STEP_DEAD && step != UR_STEP_DESCEND)
+			{
+				t++;
+				continue;
+			}
+			if (step == UR_STEP_DESCEND)
+			{
+				// ur_find_node never comes back from a child, so the next threads are dropped
+				// and replaced by the children
+				urlrouter_matcher_thread from = m->threads[t];
+				m->thread_cnt = t;
+				ur_matcher_enter(m, &from, from.node->first_child, chunk[i], i);
+				break;
+			}
+			for (unsigned int j = t + 1; j < m->thread_cnt; j++)
+				m->threads[j - 1] = m->threads[j];
+			m->thread_cnt--;
+		}
+	}
+	m->chunk++;
+
+	if (m->err != 0)
+		return m->err;
+	return !m->started || m->thread_cnt > 0;
+}
+
+URLROUTER_API const void *urlrouter_match_end(urlrouter_matcher *matcher,
+											  urlrouter_chunk_param *params,
+											  const unsigned int len, unsigned int *param_cnt)
+{
+	if (param_cnt)
+		*param_cnt = 0;
+	if (matcher->err != 0)
+		return NULL;
+
+	// The first node fully matched is the one ur_find_node returns
+	for (unsigned int i = 0; i < matcher->thread_cnt; i++)
+	{
+		const urlrouter_matcher_thread *t = &matcher->threads[i];
+		if (t->off != ur_node_steps(t->node))
+			continue;
+
+		unsigned int cnt = t->param_cnt;
+		if (cnt > URLROUTER_MATCHER_PARAMS)
+			cnt = URLROUTER_MATCHER_PARAMS;
+		if (params == NULL)
+			cnt = 0;
+		else if (cnt > len)
+			cnt = len;
+		for (unsigned int j = 0; j < cnt; j++)
+			params[j] = t->params[j];
+		if (param_cnt)
+			*param_cnt = cnt;
+		return t->node->data;
+	}
+	return NULL;
+}
+
+// Highest number of tree positions in a state of the DFA
+#define UR_DFA_POS 64
+
+// A position of ur_find_node in the tree, see ur_step_node
+typedef struct
+{
+	const urlrouter_node *node;
+	unsigned char off;
+	unsigned char in_param;
+} ur_dfa_pos;
+
+// An entry of the hash table of the states, while the DFA is compiled
+typedef struct
+{
+	unsigned int hash;
+	// 0 for an empty slot, the dead state is not stored
+	unsigned int id;
+	unsigned int cnt;
+	// Offset of the positions in the buffer, in pointers
+	unsigned int pos;
+} ur_dfa_slot;
+
+typedef struct
+{
+	urlrouter *router;
+	struct urlrouter_dfa *dfa;
+	unsigned int *table;
+	unsigned int stride;
+	// The rows grow up from `lo`, the states and their hash table are stored down from `hi`
+	char *lo;
+	char *hi;
+	ur_dfa_slot *slots;
+	unsigned int slot_mask;
+	int err;
+} ur_dfa_build;
+
+static inline void *ur_dfa_scratch(ur_dfa_build *b, unsigned long size)
+{
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	if ((unsigned long)(b->hi - b->lo) < size)
+	{
+		b->err = URLROUTER_ERR_BUFF_FULL;
+		return NULL;
+	}
+	b->hi -= size;
+	return b->hi;
+}
+
+static inline void ur_dfa_slot_put(ur_dfa_slot *slots, unsigned int mask, ur_dfa_slot slot)
+{
+	unsigned int i = slot.hash & mask;
+	while (slots[i].id != 0)
+		i = (i + 1) & mask;
+	slots[i] = slot;
+}
+
+// Mark the bytes of the fragments and find the node of each route
+static inline void ur_dfa_scan(const urlrouter_node *node, unsigned char *marks,
+							   const urlrouter_node **nodes)
+{
+	for (; node != NULL; node = node->next_sibling)
+	{
+		for (unsigned int i = 0; node->kind == URLROUTER_NODE_STATIC && i < node->frag_len; i++)
+			marks[(unsigned char)node->frag[i]] = 1;
+		if (node->data != NULL)
+			nodes[node->id] = node;
+		ur_dfa_scan(node->first_child, marks, nodes);
+	}
+}
+
+// Add the positions of the sibling chain `node` that match `c` after the `n` positions of
+// `next`. Returns the new number of positions, or -1 if there are too many.
+static inline int ur_dfa_enter(ur_dfa_pos *next, int n, const urlrouter_node *node, char c)
+{
+	for (; node != NULL; node = node->next_sibling)
+	{
+		ur_dfa_pos pos = {node, 0, 0};
+		if (ur_step_node(node, &pos.off, &pos.in_param, c) == UR_STEP_DEAD)
+			continue;
+		if (n == UR_DFA_POS)
+			return -1;
+		next[n++] = pos;
+	}
+	return n;
+}
+
+// Find or add the state of `n` positions, returns its id
+static inline unsigned int ur_dfa_state(ur_dfa_build *b, const ur_dfa_pos *pos, unsigned int n)
+{
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < n; i++)
+	{
+		unsigned long key = (unsigned long)pos[i].node ^ pos[i].off << 1 ^ pos[i].in_param;
+		hash = (hash ^ (unsigned int)(key ^ key >> 32)) * 16777619u;
+	}
+
+	unsigned int i = hash & b->slot_mask;
+	for (; b->slots[i].id != 0; i = (i + 1) & b->slot_mask)
+	{
+		const ur_dfa_slot *slot = &b->slots[i];
+		if (slot->hash != hash || slot->cnt != n)
+			continue;
+		const ur_dfa_pos *other =
+			(const ur_dfa_pos *)((char *)b->router->buffer + slot->pos * sizeof(void *));
+		unsigned int j = 0;
+		while (j < n && other[j].node == pos[j].node && other[j].off == pos[j].off &&
+			   other[j].in_param == pos[j].in_param)
+			j++;
+		if (j == n)
+			return slot->id;
+	}
+
+	// A new state: its positions are kept in the scratch space and its row is added
+	ur_dfa_pos *copy = (ur_dfa_pos *)ur_dfa_scratch(b, n * sizeof(ur_dfa_pos));
+	unsigned int id = b->dfa->state_cnt;
+	if (copy == NULL || (unsigned long)(b->hi - b->lo) < b->stride * sizeof(unsigned int) ||
+		id >= ~0u / b->stride)
+	{
+		b->err = URLROUTER_ERR_BUFF_FULL;
+		return 0;
+	}
+	for (unsigned int j = 0; j < n; j++)
+		copy[j] = pos[j];
+	// Until the row is filled, it holds where the positions are
+	unsigned int *row = b->table + (unsigned long)id * b->stride;
+	row[0] = ((char *)copy - (char *)b->router->buffer) / sizeof(void *);
+	row[1] = n;
+	b->lo += b->stride * sizeof(unsigned int);
+	b->dfa->state_cnt++;
+
+	b->slots[i] = (ur_dfa_slot){hash, id, n, row[0]};
+	if (4 * b->dfa->state_cnt > 3 * b->slot_mask)
+	{
+		// Grow the hash table, the old one is left in the scratch space
+		unsigned int mask = 2 * b->slot_mask + 1;
+		ur_dfa_slot *slots = (ur_dfa_slot *)ur_dfa_scratch(b, (mask + 1) * sizeof(ur_dfa_slot));
+		if (slots == NULL)
+			return 0;
+		for (unsigned int j = 0; j <= mask; j++)
+			slots[j].id = 0;
+		for (unsigned int j = 0; j <= b->slot_mask; j++)
+		{
+			if (b->slots[j].id != 0)
+				ur_dfa_slot_put(slots, mask, b->slots[j]);
+		}
+		b->slots = slots;
+		b->slot_mask = mask;
+	}
+	return id;
+}
+
+// The state reached from the `n` positions `pos` with the byte `c`. The positions are
+// stepped in order like the threads of urlrouter_match_feed.
+static inline unsigned int ur_dfa_next(ur_dfa_build *b, const ur_dfa_pos *pos, unsigned int n,
+									   char c)
+{
+	ur_dfa_pos next[UR_DFA_POS];
+	int cnt = 0;
+	for (unsigned int i = 0; i < n && cnt >= 0; i++)
+	{
+		ur_dfa_pos p = pos[i];
+		int step = ur_step_node(p.node, &p.off, &p.in_param, c);
+		if (step == UR_STEP_DESCEND)
+		{
+			cnt = ur_dfa_enter(next, cnt, p.node->first_child, c);
+			break;
+		}
+		if (step != UR_STEP_DEAD)
+			next[cnt++] = p;
+	}
+	if (cnt < 0)
+	{
+		b->err = URLROUTER_ERR_BUFF_FULL;
+		return 0;
+	}
+	return cnt > 0 ? ur_dfa_state(b, next, cnt) : 0;
+}
+
+// Compile the routes added without host into a DFA with a subset construction: a state is
+// the ordered list of tree positions ur_find_node could still be at.
+static inline int ur_compile_dfa(urlrouter *router)
+{
+	unsigned long cursor = router->cursor;
+	struct urlrouter_dfa *dfa = (struct urlrouter_dfa *)ur_alloc(router, sizeof(*dfa));
+	const urlrouter_node **nodes = (const urlrouter_node **)ur_alloc(
+		router, (router->route_cnt ? router->route_cnt : 1) * sizeof(urlrouter_node *));
+	if (dfa == NULL || nodes == NULL)
+	{
+		router->cursor = cursor;
+		return URLROUTER_ERR_BUFF_FULL;
+	}
+	for (unsigned int i = 0; i < router->route_cnt; i++)
+		nodes[i] = NULL;
+
+	// Bytes that don't appear in any fragment can only be matched by a param, they share
+	// class 0 with '\0'. The class of '/', which ends params, is 1.
+	unsigned char reps[256];
+	for (unsigned int i = 0; i < 256; i++)
+		dfa->classes[i] = 0;
+	ur_dfa_scan(router->root, dfa->classes, nodes);
+	dfa->class_cnt = 1;
+	reps[0] = 0;
+	for (unsigned int i = 1; i < 256; i++)
+	{
+		if (dfa->classes[i] == 0 && reps[0] == 0)
+			reps[0] = i;
+		else if (dfa->classes[i] != 0 && i != '/')
+			reps[dfa->class_cnt] = i;
+		if (dfa->classes[i] != 0 && i != '/')
+			dfa->classes[i] = dfa->class_cnt++;
+	}
+	dfa->classes['/'] = dfa->class_cnt;
+	reps[dfa->class_cnt++] = '/';
+	dfa->nodes = nodes;
+	dfa->cursor = cursor;
+	dfa->state_cnt = 2;
+
+	ur_dfa_build b = {router, dfa, (unsigned int *)((char *)router->buffer + router->cursor),
+					  dfa->class_cnt + 1, NULL, NULL, NULL, 0, 0};
+	b.lo = (char *)(b.table + 2 * b.stride);
+	b.hi = (char *)router->buffer + router->len - router->route_cnt * sizeof(urlrouter_route);
+	b.slot_mask = 31;
+	b.slots = b.lo <= b.hi ? (ur_dfa_slot *)ur_dfa_scratch(&b, 32 * sizeof(ur_dfa_slot)) : NULL;
+	if (b.slots == NULL)
+	{
+		router->cursor = cursor;
+		return URLROUTER_ERR_BUFF_FULL;
+	}
+	for (unsigned int i = 0; i <= b.slot_mask; i++)
+		b.slots[i].id = 0;
+
+	// The dead state loops on itself and the start state enters the root chain
+	for (unsigned int k = 0; k < b.stride; k++)
+		b.table[k] = 0;
+	for (unsigned int k = 0; k < dfa->class_cnt && b.err == 0; k++)
+	{
+		ur_dfa_pos next[UR_DFA_POS];
+		int cnt = reps[k] != 0 ? ur_dfa_enter(next, 0, router->root, reps[k]) : 0;
+		if (cnt < 0)
+			b.err = URLROUTER_ERR_BUFF_FULL;
+		b.table[b.stride + k] = cnt > 0 ? ur_dfa_state(&b, next, cnt) : 0;
+	}
+	b.table[b.stride + dfa->class_cnt] = 0;
+
+	for (unsigned int s = 2; s < dfa->state_cnt && b.err == 0; s++)
+	{
+		unsigned int *row = b.table + (unsigned long)s * b.stride;
+		const ur_dfa_pos *pos =
+			(const ur_dfa_pos *)((char *)router->buffer + (unsigned long)row[0] * sizeof(void *));
+		unsigned int n = row[1];
+
+		// The first position at the end of its fragment is the node ur_find_node returns
+		unsigned int accept = 0;
+		for (unsigned int i = 0; i < n; i++)
+		{
+			if (pos[i].off == ur_node_steps(pos[i].node))
+			{
+				accept = pos[i].node->data != NULL ? pos[i].node->id + 1 : 0;
+				break;
+			}
+		}
+		for (unsigned int k = 0; k < dfa->class_cnt && b.err == 0; k++)
+			row[k] = reps[k] != 0 ? ur_dfa_next(&b, pos, n, reps[k]) : 0;
+		row[dfa->class_cnt] = accept;
+	}
+	if (b.err != 0)
+	{
+		router->cursor = cursor;
+		return b.err;
+	}
+
+	// The transitions give the offset of the row of the next state
+	for (unsigned long i = 0; i < (unsigned long)dfa->state_cnt * b.stride; i++)
+	{
+		if (i % b.stride != dfa->class_cnt)
+			b.table[i] *= b.stride;
+	}
+	dfa->table = b.table;
+	router->cursor = b.lo - (char *)router->buffer;
+	router->cursor = (router->cursor + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	router->dfa = dfa;
+	return ur_rem_space(router);
+}
+
+URLROUTER_API int urlrouter_set_engine(urlrouter *router, int engine)
+{
+	const struct urlrouter_dfa *dfa = router->dfa;
+	if (dfa != NULL)
+	{
+		// The DFA is freed if nothing was allocated after it
+		router->dfa = NULL;
+		const char *end = (const char *)(dfa->table + (unsigned long)dfa->state_cnt *
+															(dfa->class_cnt + 1));
+		unsigned long end_cursor = end - (const char *)router->buffer;
+		if (router->cursor == ((end_cursor + sizeof(void *) - 1) & ~(sizeof(void *) - 1)))
+			router->cursor = dfa->cursor;
+	}
+	if (engine == URLROUTER_ENGINE_DFA)
+		return router->mounts == NULL ? ur_compile_dfa(router) : URLROUTER_ERR_MOUNTED;
+	return ur_rem_space(router);
+}
+
+// Where an object of the regions from `r` is copied by urlrouter_repack, the regions being
+// copied one after the other at `dst`. Pointers outside of them, like the routes given to
+// urlrouter_add or the nodes of a mounted router, are returned as is.
+static inline void *ur_repack_ptr(ur_region r, char *dst, const void *p)
+{
+	const char *c = (const char *)p;
+	do
+	{
+		if (c >= r.buffer + r.start && c < r.buffer + r.used)
+			return dst + (c - r.buffer - r.start);
+		dst += r.used - r.start;
+	} while (ur_next_region(&r));
+	return (void *)p;
+}
+
+// Relocate the pointers of the nodes copied from the regions at `r`. The nodes of a mounted
+// router are not copied and not visited.
+static inline void ur_repack_node(ur_region r, char *dst, urlrouter_node *node)
+{
+	for (; node != NULL; node = node->next_sibling)
+	{
+		node->frag = (const char *)ur_repack_ptr(r, dst, node->frag);
+		node->next_sibling = (urlrouter_node *)ur_repack_ptr(r, dst, node->next_sibling);
+		urlrouter_node *child = (urlrouter_node *)ur_repack_ptr(r, dst, node->first_child);
+		if (child != node->first_child)
+		{
+			node->first_child = child;
+			ur_repack_node(r, dst, child);
+		}
+	}
+}
+
+URLROUTER_API int urlrouter_repack(urlrouter *router)
+{
+	const urlrouter_allocator *a = &router->allocator;
+	if (router->chunk_cnt == 0)
+		return ur_rem_space(router);
+
+	// The regions are copied from the current one, then the route records at the end
+	ur_region r = ur_first_region(router), it = r;
+	unsigned long used = 0, routes = router->route_cnt * sizeof(urlrouter_route);
+	do
+		used += it.used - it.start;
+	while (ur_next_region(&it));
+	unsigned long len = sizeof(ur_chunk) + used + routes;
+	char *chunk = (char *)a->alloc(a->user, len);
+	if (chunk == NULL)
+		return URLROUTER_ERR_BUFF_FULL;
+
+	char *dst = chunk + sizeof(ur_chunk);
+	it = r;
+	do
+	{
+		for (unsigned long i = it.start; i < it.used; i++)
+			*dst++ = it.buffer[i];
+	} while (ur_next_region(&it));
+	const char *from = (const char *)router->buffer + router->len - routes;
+	for (unsigned long i = 0; i < routes; i++)
+		chunk[len - routes + i] = from[i];
+	// The buffer given to urlrouter_init is not used anymore
+	*(ur_chunk *)chunk = (ur_chunk){it.buffer, it.len, 0};
+
+	dst = chunk + sizeof(ur_chunk);
+	router->root = (urlrouter_node *)ur_repack_ptr(r, dst, router->root);
+	router->host_root = (urlrouter_node *)ur_repack_ptr(r, dst, router->host_root);
+	ur_repack_node(r, dst, router->root);
+	ur_repack_node(r, dst, router->host_root);
+	urlrouter_route *route = (urlrouter_route *)(chunk + len) - router->route_cnt;
+	for (; (char *)route < chunk + len; route++)
+	{
+		route->pieces = (const urlrouter_piece *)ur_repack_ptr(r, dst, route->pieces);
+		urlrouter_piece *pieces = (urlrouter_piece *)route->pieces;
+		for (unsigned int i = 0; i < route->piece_cnt; i++)
+			pieces[i].str = (const char *)ur_repack_ptr(r, dst, pieces[i].str);
+	}
+	router->mounts = (struct urlrouter_mount *)ur_repack_ptr(r, dst, router->mounts);
+	for (struct urlrouter_mount *m = router->mounts; m != NULL; m = m->next)
+	{
+		m->node = (const urlrouter_node *)ur_repack_ptr(r, dst, m->node);
+		m->next = (struct urlrouter_mount *)ur_repack_ptr(r, dst, m->next);
+	}
+	if (router->dfa != NULL)
+	{
+		struct urlrouter_dfa *dfa = (struct urlrouter_dfa *)ur_repack_ptr(r, dst, router->dfa);
+		dfa->table = (const unsigned int *)ur_repack_ptr(r, dst, dfa->table);
+		dfa->nodes = (const urlrouter_node **)ur_repack_ptr(r, dst, dfa->nodes);
+		for (unsigned int i = 0; i < router->route_cnt; i++)
+			dfa->nodes[i] = (const urlrouter_node *)ur_repack_ptr(r, dst, dfa->nodes[i]);
+		// The DFA was compiled at the cursor
+		dfa->cursor = (char *)dfa - chunk;
+		router->dfa = dfa;
+	}
+
+	// The chunks are released once nothing is read from them anymore
+	for (it = r; it.chunk > 0;)
+	{
+		char *old = it.buffer;
+		unsigned long old_len = it.len;
+		ur_next_region(&it);
+		if (a->free)
+			a->free(a->user, old, old_len);
+	}
+	router->buffer = chunk;
+	router->len = len;
+	router->cursor = sizeof(ur_chunk) + used;
+	router->chunk_cnt = 1;
+	return ur_rem_space(router);
+}
+
+// FNV-1a hash of the path. `len` is set to its length, or to URLROUTER_CACHE_PATH + 1 if it is
+// too long to be cached, in which case the hash is meaningless.
+static inline unsigned int ur_cache_hash(const char *path, unsigned int *len)
+{
+	unsigned int hash = 2166136261u, i = 0;
+	for (; path[i] != '\0' && i <= URLROUTER_CACHE_PATH; i++)
+		hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+	*len = i;
+	return hash;
+}
+
+URLROUTER_API void urlrouter_cache_init(urlrouter_cache *cache)
+{
+	// An empty path has the length of an empty entry, which must not match any router
+	for (unsigned int i = 0; i < URLROUTER_CACHE_ENTRIES; i++)
+	{
+		cache->entries[i].router = NULL;
+		cache->entries[i].len = 0;
+	}
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+URLROUTER_API const void *urlrouter_find_cached(const urlrouter *router, urlrouter_cache *cache,
+												const char *path, urlparam *params,
+												const unsigned int len, unsigned int *param_cnt)
+{
+	unsigned int path_len, i;
+	unsigned int hash = ur_cache_hash(path, &path_len);
+	urlrouter_cache_entry *e = &cache->entries[hash & (URLROUTER_CACHE_ENTRIES - 1)];
+	if (e->len == path_len && e->router == router && e->generation == router->generation)
+	{
+		for (i = 0; i < path_len && e->path[i] == path[i]; i++)
+			;
+		if (i == path_len)
+		{
+			cache->hits++;
+			unsigned int cnt = params == NULL ? 0 : e->param_cnt < len ? e->param_cnt : len;
+			for (i = 0; i < cnt; i++)
+			{
+				params[i].value = path + e->param_off[i];
+				params[i].len = e->param_len[i];
+			}
+			if (param_cnt)
+				*param_cnt += cnt;
+			return e->data;
+		}
+	}
+
+	cache->misses++;
+	unsigned int cnt = 0;
+	ur_mount_hit hit = {router, 0, 0};
+	urlrouter_node *node = ur_find_root(router, path, params, len, &cnt, 1, &hit);
+	if (param_cnt)
+		*param_cnt += cnt;
+	if (node == NULL || node->data == NULL)
+		return NULL;
+
+	// The path is only stored if all the params of the route were given back
+	if (path_len <= URLROUTER_CACHE_PATH && cnt <= URLROUTER_CACHE_PARAMS &&
+		cnt == hit.param_i + ur_get_route(hit.router, node->id)->param_cnt)
+	{
+		e->data = node->data;
+		e->router = router;
+		e->generation = router->generation;
+		e->len = path_len;
+		e->param_cnt = cnt;
+		for (i = 0; i < cnt; i++)
+		{
+			e->param_off[i] = params[i].value - path;
+			e->param_len[i] = params[i].len;
+		}
+		for (i = 0; i < path_len; i++)
+			e->path[i] = path[i];
+	}
+	return node->data;
+}
+
+#ifdef URLROUTER_IO
+static inline void ur_print_node(const urlrouter_node *node, int depth)
+{
+	while (node != NULL)
+	{
+		// Print the indentation for the current depth
+		printf("|");
+		for (int i = 0; i < depth; ++i)
+			printf(" ");
+
+		if (depth > 0)
+			printf("└");
+		else
+			printf("-");
+		// Print the fragment, a param between braces
+		int width = node->frag_len;
+		if (node->kind == URLROUTER_NODE_PARAM)
+		{
+			printf("{%.*s}", node->frag_len, node->frag);
+			width += 2;
+		}
+		else
+		{
+			// Escape the braces like in the route
+			for (unsigned int i = 0; i < node->frag_len; i++)
+			{
+				ur_bool brace = node->frag[i] == '{' || node->frag[i] == '}';
+				printf(brace ? "%c%c" : "%c", node->frag[i], node->frag[i]);
+				width += brace;
+			}
+		}
+
+		for (int i = 0; i < 50 - width - depth; ++i)
+			printf(" ");
+		printf("-> %p\n", node->data);
+
+		// Print the first child with increased depth
+		if (node->first_child != NULL)
+		{
+			ur_print_node(node->first_child, depth + width);
+		}
+
+		// Move to the next sibling
+		node = node->next_sibling;
+	}
+}
+URLROUTER_API void urlrouter_print(const urlrouter *router)
+{
+	printf("URL Router:\n");
+	ur_print_node(router->root, 0);
+	if (router->host_root)
+	{
+		printf("Hosts:\n");
+		ur_print_node(router->host_root, 0);
+	}
+}
+
+#endif // URLROUTER_IO
+
+#endif // URLROUTER_IMPLEMENTATION
+
 #endif // URLROUTER_H
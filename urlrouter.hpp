@@ -0,0 +1,375 @@
+// MIT License
+//
+// Copyright (c) 2024 Théodore Prévot
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// C++17 router built at compile time from a constexpr route table.
+// The tree is built like urlrouter_build does: the routes are sorted by symbol, a {param}
+// sorting after every literal byte, so static fragments keep priority over params exactly
+// like with urlrouter_add. A malformed or duplicated route is a compile error.
+
+#ifndef URLROUTER_HPP
+#define URLROUTER_HPP
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+namespace urlrouter_cpp
+{
+	/**
+	 * A route of the table: its path and the handler returned when it matches.
+	 * The handler type must be default constructible, like a function pointer.
+	 */
+	template <typename Handler> struct route
+	{
+		std::string_view path;
+		Handler handler;
+	};
+
+	/**
+	 * The result of a lookup. The params are slices of the looked up path, in the order
+	 * of the route.
+	 */
+	template <typename Handler, std::size_t MaxParams> struct match
+	{
+		Handler handler{};
+		// Index of the route in the table
+		std::size_t route = 0;
+		std::array<std::string_view, MaxParams> params{};
+		std::size_t param_cnt = 0;
+		bool found = false;
+
+		constexpr explicit operator bool() const { return found; }
+	};
+
+	namespace detail
+	{
+		// Build errors. They are not constexpr so that a bad route table fails to compile
+		// with the name of the error in the message.
+		inline void malformed_path() { throw std::invalid_argument("urlrouter: malformed path"); }
+		inline void path_exists() { throw std::invalid_argument("urlrouter: path already exists"); }
+		inline void too_many_params() { throw std::invalid_argument("urlrouter: too many params"); }
+
+		constexpr std::size_t npos = static_cast<std::size_t>(-1);
+		constexpr int SYM_END = -1;
+		constexpr int SYM_PARAM = 256;
+
+		constexpr bool is_escape(std::string_view p, std::size_t i)
+		{
+			return i + 1 < p.size() && (p[i] == '{' || p[i] == '}') && p[i + 1] == p[i];
+		}
+
+		constexpr bool is_param_char(char c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+		}
+
+		// Read the symbol at `i`. `{{` and `}}` are read as their literal brace and a whole
+		// {param} is SYM_PARAM. `width` is set to the number of bytes of the symbol.
+		constexpr int path_sym(std::string_view p, std::size_t i, std::size_t &width)
+		{
+			if (i >= p.size())
+			{
+				width = 0;
+				return SYM_END;
+			}
+			if (is_escape(p, i))
+			{
+				width = 2;
+				return static_cast<unsigned char>(p[i]);
+			}
+			if (p[i] != '{')
+			{
+				width = 1;
+				return static_cast<unsigned char>(p[i]);
+			}
+			std::size_t end = i + 1;
+			while (p[end] != '}')
+				end++;
+			width = end + 1 - i;
+			return SYM_PARAM;
+		}
+
+		// Same rules as verify_path: params are closed, alphanumeric, and followed by a '/'
+		// or the end of the path. Returns the number of params.
+		constexpr std::size_t verify_path(std::string_view p)
+		{
+			std::size_t params = 0;
+			if (p.empty())
+				malformed_path();
+			for (std::size_t i = 0; i < p.size();)
+			{
+				if (is_escape(p, i))
+				{
+					i += 2;
+					continue;
+				}
+				if (p[i] == '}')
+					malformed_path();
+				if (p[i] != '{')
+				{
+					i++;
+					continue;
+				}
+
+				std::size_t end = i + 1;
+				while (end < p.size() && is_param_char(p[end]))
+					end++;
+				if (end == i + 1 || end == p.size() || p[end] != '}')
+					malformed_path();
+				if (end + 1 < p.size() && p[end + 1] != '/')
+					malformed_path();
+				params++;
+				i = end + 1;
+			}
+			return params;
+		}
+
+		// Compare two paths symbol by symbol
+		constexpr int compare(std::string_view a, std::string_view b)
+		{
+			std::size_t i = 0, j = 0, wa = 0, wb = 0;
+			for (;;)
+			{
+				int sa = path_sym(a, i, wa), sb = path_sym(b, j, wb);
+				if (sa != sb)
+					return sa < sb ? -1 : 1;
+				if (sa == SYM_END)
+					return 0;
+				i += wa;
+				j += wb;
+			}
+		}
+	} // namespace detail
+
+	/**
+	 * A radix tree of `N` routes built by the constructor. When the router is constexpr,
+	 * the whole tree is built at compile time and lookups have no startup cost.
+	 * Lookups have the same semantics as urlrouter_find: a param matches up to the next '/'
+	 * and there is no backtracking once a child is entered.
+	 */
+	template <typename Handler, std::size_t N, std::size_t MaxParams = 8> class router
+	{
+	  public:
+		using match_type = match<Handler, MaxParams>;
+
+		constexpr explicit router(const route<Handler> (&routes)[N])
+		{
+			std::array<std::size_t, N> order{}, offset{};
+			for (std::size_t i = 0; i < N; i++)
+			{
+				if (detail::verify_path(routes[i].path) > MaxParams)
+					detail::too_many_params();
+				routes_[i] = routes[i];
+				order[i] = i;
+			}
+
+			// Insertion sort, the tables are small and it is evaluated by the compiler
+			for (std::size_t i = 1; i < N; i++)
+			{
+				for (std::size_t j = i; j > 0; j--)
+				{
+					int cmp = detail::compare(path(order[j - 1]), path(order[j]));
+					if (cmp == 0)
+						detail::path_exists();
+					if (cmp < 0)
+						break;
+					std::size_t tmp = order[j];
+					order[j] = order[j - 1];
+					order[j - 1] = tmp;
+				}
+			}
+			root_ = build(order, offset, 0, N);
+		}
+
+		/**
+		 * @brief Find the route matching `path`
+		 * @returns The match, that converts to false if no route matches
+		 */
+		constexpr match_type find(std::string_view path) const
+		{
+			match_type m;
+			std::size_t n = root_, pos = 0, start_cnt = 0;
+			while (n != detail::npos)
+			{
+				const node &nd = nodes_[n];
+				std::size_t p = pos;
+				int res = match_frag(nd.frag, path, p, m);
+				bool matched = res > 0;
+				if (matched && p == path.size())
+				{
+					m.found = nd.route != detail::npos;
+					if (m.found)
+					{
+						m.handler = routes_[nd.route].handler;
+						m.route = nd.route;
+					}
+					return m;
+				}
+				if (matched && nd.first_child != detail::npos)
+				{
+					n = nd.first_child;
+					pos = p;
+					start_cnt = m.param_cnt;
+					continue;
+				}
+
+				// Undo the partial match, the sibling may be a param matching it
+				if (res < 0 || res > 1)
+					return m;
+				n = nd.next_sibling;
+				m.param_cnt = start_cnt;
+			}
+			return m;
+		}
+
+		constexpr std::size_t size() const { return N; }
+		constexpr std::size_t node_count() const { return node_cnt_; }
+
+	  private:
+		struct node
+		{
+			std::string_view frag;
+			std::size_t first_child = detail::npos;
+			std::size_t next_sibling = detail::npos;
+			// Index of the route ending at this node
+			std::size_t route = detail::npos;
+		};
+
+		// A radix tree of N routes has at most 2N - 1 nodes
+		std::array<node, 2 * N> nodes_{};
+		std::array<route<Handler>, N> routes_{};
+		std::size_t node_cnt_ = 0;
+		std::size_t root_ = detail::npos;
+
+		constexpr std::string_view path(std::size_t route) const { return routes_[route].path; }
+
+		// Build the sibling chain of the sorted routes [lo, hi), which share the symbols
+		// before their offset. Same algorithm as build_level.
+		constexpr std::size_t build(std::array<std::size_t, N> &order,
+									std::array<std::size_t, N> &offset, std::size_t lo,
+									std::size_t hi)
+		{
+			std::size_t head = detail::npos, last = detail::npos, w = 0;
+			while (lo < hi)
+			{
+				// Group the routes starting with the same symbol, they will share a node
+				std::string_view first = path(order[lo]);
+				int sym = detail::path_sym(first, offset[order[lo]], w);
+				std::size_t end = lo + 1;
+				while (end < hi && detail::path_sym(path(order[end]), offset[order[end]], w) == sym)
+					end++;
+
+				// The fragment is the common prefix of the first and last routes of the group
+				std::string_view lst = path(order[end - 1]);
+				std::size_t a = offset[order[lo]], b = offset[order[end - 1]], syms = 0, wa = 0;
+				int sa = 0;
+				while ((sa = detail::path_sym(first, a, wa)) == detail::path_sym(lst, b, w) &&
+					   sa != detail::SYM_END)
+				{
+					a += wa;
+					b += w;
+					syms++;
+				}
+
+				std::size_t idx = node_cnt_++;
+				nodes_[idx].frag = first.substr(offset[order[lo]], a - offset[order[lo]]);
+				for (std::size_t i = lo; i < end; i++)
+				{
+					for (std::size_t s = 0; s < syms; s++)
+					{
+						detail::path_sym(path(order[i]), offset[order[i]], w);
+						offset[order[i]] += w;
+					}
+				}
+
+				// An exhausted route sorts first, there is no duplicate
+				std::size_t child = lo;
+				if (offset[order[lo]] == first.size())
+				{
+					nodes_[idx].route = order[lo];
+					child++;
+				}
+				if (child < end)
+					nodes_[idx].first_child = build(order, offset, child, end);
+
+				if (last != detail::npos)
+					nodes_[last].next_sibling = idx;
+				else
+					head = idx;
+				last = idx;
+				lo = end;
+			}
+			return head;
+		}
+
+		// The C tree has a node per param and per literal run, a run ending after an escaped
+		// brace or after 127 bytes, and never comes back from a child. So once one of these
+		// tokens of `frag` matched, the siblings of the node can't be tried anymore: -1 is
+		// returned instead of 0 for a mismatch and 2 instead of 1 for a match.
+		static constexpr int match_frag(std::string_view frag, std::string_view path,
+										std::size_t &p, match_type &m)
+		{
+			std::size_t w = 0, run = 0;
+			bool token_end = false, crossed = false;
+			for (std::size_t i = 0; i < frag.size(); i += w)
+			{
+				int sym = detail::path_sym(frag, i, w);
+				if (i > 0 && (token_end || sym == detail::SYM_PARAM || run == 127))
+				{
+					crossed = true;
+					run = 0;
+				}
+				token_end = sym == detail::SYM_PARAM || w == 2;
+				run += sym != detail::SYM_PARAM;
+				if (sym == detail::SYM_PARAM)
+				{
+					std::size_t end = p;
+					while (end < path.size() && path[end] != '/')
+						end++;
+					if (end == p)
+						return crossed ? -1 : 0;
+					m.params[m.param_cnt++] = path.substr(p, end - p);
+					p = end;
+				}
+				else if (p < path.size() && static_cast<unsigned char>(path[p]) == sym)
+					p++;
+				else
+					return crossed ? -1 : 0;
+			}
+			return crossed ? 2 : 1;
+		}
+	};
+
+	/**
+	 * @brief Build a router from a route table, like
+	 * `constexpr auto router = urlrouter_cpp::make_router(routes);`
+	 * @param MaxParams The highest number of params of a route
+	 */
+	template <std::size_t MaxParams = 8, typename Handler, std::size_t N>
+	constexpr router<Handler, N, MaxParams> make_router(const route<Handler> (&routes)[N])
+	{
+		return router<Handler, N, MaxParams>(routes);
+	}
+} // namespace urlrouter_cpp
+
+#endif // URLROUTER_HPP